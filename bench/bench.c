@@ -0,0 +1,381 @@
+/*!
+ * @file bench.c
+ * Benchmark driver timing each phase of the cdoc pipeline over corpora
+ * written by the corpus program.
+ * Results are written to stdout as a JSON array with one object per
+ * corpus.
+ * @license 0BSD
+ */
+
+// The driver is built from the cdoc translation unit itself so that each
+// phase can be called and timed directly.
+#define main cdoc_main
+#include "../cdoc.c"
+#undef main
+
+#include <dirent.h>
+
+/*!
+ * @struct phases
+ * Time in seconds spent in each phase of the pipeline.
+ */
+struct phases
+{
+    /*! @member read
+     * Time spent in read_text_file.
+     */
+    double read;
+    /*! @member lines
+     * Time spent in text_to_lines.
+     */
+    double lines;
+    /*! @member scan
+     * Time spent in the doc-line loop of parse_text, excluding parse_doc.
+     */
+    double scan;
+    /*! @member parse
+     * Time spent in parse_doc.
+     */
+    double parse;
+    /*! @member print
+     * Time spent in print_doc, rendering into memory.
+     */
+    double print;
+    /*! @member source
+     * Time spent writing the source lines of every doc verbatim.
+     */
+    double source;
+    /*! @member escape
+     * Time spent writing the same lines through html_write_line.
+     */
+    double escape;
+    /*! @member total
+     * Time spent processing the whole corpus.
+     */
+    double total;
+};
+
+/*!
+ * @struct counts
+ * Size of a corpus.
+ */
+struct counts
+{
+    /*! @member files
+     * Number of files in the corpus.
+     */
+    size_t files;
+    /*! @member bytes
+     * Total size of the files in bytes.
+     */
+    size_t bytes;
+    /*! @member lines
+     * Total number of lines in the files.
+     */
+    size_t lines;
+    /*! @member docs
+     * Total number of docs in the files.
+     */
+    size_t docs;
+};
+
+/*!
+ * @function now
+ * Returns the current time of the monotonic clock in seconds.
+ */
+static double
+now(void);
+/*!
+ * @function list_dir
+ * Returns the sorted, heap-allocated list of paths of the regular files in
+ * the directory dir, and stores the number of paths in *count.
+ */
+static char**
+list_dir(char const* dir, size_t* count);
+/*!
+ * @function compare_paths
+ * Comparison function for sorting a list of paths with qsort.
+ */
+static int
+compare_paths(void const* a, void const* b);
+/*!
+ * @function bench_file
+ * Run every phase of the pipeline over the file at path once, adding the
+ * time spent in each phase to p and the size of the file to c.
+ */
+static void
+bench_file(
+    struct job* job, char const* path, struct phases* p, struct counts* c);
+/*!
+ * @function print_result
+ * Write the JSON object describing the benchmark of one corpus to stdout.
+ */
+static void
+print_result(
+    char const* dir,
+    char const* format,
+    int repeat,
+    struct phases const* best,
+    struct counts const* c);
+
+int
+main(int argc, char** argv)
+{
+    int repeat = 5;
+    char const* format = "html";
+    int first = 1;
+    for (; first < argc && argv[first][0] == '-'; ++first) {
+        if (strcmp(argv[first], "-r") == 0 && first + 1 < argc) {
+            repeat = atoi(argv[++first]);
+            if (repeat < 1) {
+                errorf("Invalid repeat count '%s'", argv[first]);
+            }
+        }
+        else if (strcmp(argv[first], "-f") == 0 && first + 1 < argc) {
+            format = argv[++first];
+        }
+        else {
+            fputs("Usage: bench [-r REPEAT] [-f FORMAT] DIR...\n", stderr);
+            return EXIT_FAILURE;
+        }
+    }
+
+    struct target target = {0};
+    target.renderer = find_renderer(format);
+    target.path = "-";
+    if (target.renderer == NULL) {
+        errorf("Unknown output format '%s'", format);
+    }
+    struct options options = {0};
+    options.targets = &target;
+    options.target_count = 1;
+    options.jobs = 1;
+
+    struct arena arena = {0};
+    struct sink out;
+    sink_init_memory(&out);
+
+    fputs("[\n", stdout);
+    for (int d = first; d < argc; ++d) {
+        size_t count;
+        char** const paths = list_dir(argv[d], &count);
+
+        // Each phase is reported as its fastest total over the repetitions.
+        struct phases best = {0};
+        struct counts c = {0};
+        for (int r = 0; r < repeat; ++r) {
+            struct phases p = {0};
+            c = (struct counts){0};
+            double const start = now();
+            for (size_t i = 0; i < count; ++i) {
+                struct job job = {0};
+                job.options = &options;
+                job.path = paths[i];
+                job.outs = &out;
+                job.arena = &arena;
+                bench_file(&job, paths[i], &p, &c);
+                out.size = 0;
+            }
+            p.total = now() - start;
+
+            double* const bp = &best.read;
+            double const* const pp = &p.read;
+            for (size_t k = 0; k < sizeof(p) / sizeof(double); ++k) {
+                bp[k] = r == 0 || pp[k] < bp[k] ? pp[k] : bp[k];
+            }
+        }
+
+        print_result(argv[d], format, repeat, &best, &c);
+        fputs(d + 1 < argc ? ",\n" : "\n", stdout);
+        for (size_t i = 0; i < count; ++i) {
+            free(paths[i]);
+        }
+        free(paths);
+    }
+    fputs("]\n", stdout);
+
+    sink_free(&out);
+    arena_free(&arena);
+    return EXIT_SUCCESS;
+}
+
+static double
+now(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (double)ts.tv_sec + (double)ts.tv_nsec * 1e-9;
+}
+
+static char**
+list_dir(char const* dir, size_t* count)
+{
+    DIR* const dp = opendir(dir);
+    if (dp == NULL) {
+        errorf("%s: %s", dir, strerror(errno));
+    }
+    char** paths = NULL;
+    size_t cap = 0;
+    *count = 0;
+    struct dirent* ent;
+    while ((ent = readdir(dp)) != NULL) {
+        size_t const size = strlen(dir) + strlen(ent->d_name) + 2;
+        char* const path = xalloc(NULL, size);
+        snprintf(path, size, "%s/%s", dir, ent->d_name);
+        struct stat st;
+        if (stat(path, &st) != 0 || !S_ISREG(st.st_mode)) {
+            free(path);
+            continue;
+        }
+        if (*count == cap) {
+            cap = cap == 0 ? 64 : cap * 2;
+            paths = xalloc(paths, cap * sizeof(*paths));
+        }
+        paths[(*count)++] = path;
+    }
+    closedir(dp);
+    if (*count != 0) {
+        qsort(paths, *count, sizeof(*paths), compare_paths);
+    }
+    return paths;
+}
+
+static int
+compare_paths(void const* a, void const* b)
+{
+    return strcmp(*(char* const*)a, *(char* const*)b);
+}
+
+static void
+bench_file(
+    struct job* job, char const* path, struct phases* p, struct counts* c)
+{
+    FILE* const fp = fopen(path, "rb");
+    if (fp == NULL) {
+        errorf("%s: %s", path, strerror(errno));
+    }
+
+    double t = now();
+    struct text text;
+    if (!read_text_file(job, fp, &text)) {
+        errorf("%s: %s", path, job->errors[0]);
+    }
+    double u = now();
+    p->read += u - t;
+
+    t = u;
+    struct file f;
+    if (!text_to_lines(job, text, &f)) {
+        errorf("%s: %s", path, job->errors[0]);
+    }
+    u = now();
+    p->lines += u - t;
+
+    // Mirrors the doc-line loop of parse_text, timing parse_doc apart.
+    t = u;
+    double parse = 0;
+    struct doc* docs = NULL;
+    size_t doc_count = 0;
+    size_t doc_cap = 0;
+    uint32_t line = 0;
+    for (uint32_t i = 0; i < f.doc_line_count; ++i) {
+        if (f.doc_lines[i] < line) {
+            continue;
+        }
+        line = f.doc_lines[i];
+        docs = arena_push(
+            job->arena, docs, &doc_cap, doc_count, sizeof(*docs));
+        double const parse_start = now();
+        if (!parse_doc(job, &f, &line, &docs[doc_count])) {
+            errorf("%s: %s", path, job->errors[0]);
+        }
+        parse += now() - parse_start;
+        doc_count += 1;
+    }
+    u = now();
+    p->parse += parse;
+    p->scan += u - t - parse;
+
+    t = u;
+    struct output o = {0};
+    o.renderer = job->options->targets[0].renderer;
+    o.sink = job->outs;
+    if (o.renderer->begin_file != NULL) {
+        o.renderer->begin_file(&o, job->path);
+    }
+    for (size_t i = 0; i < doc_count; ++i) {
+        print_doc(&o, &f, &docs[i]);
+    }
+    if (o.renderer->end_file != NULL) {
+        o.renderer->end_file(&o);
+    }
+    p->print += now() - t;
+
+    // The source lines are written again, verbatim and then escaped, to
+    // compare the cost of escaping HTML with the copy it replaces.
+    for (int escape = 0; escape < 2; ++escape) {
+        t = now();
+        for (size_t i = 0; i < doc_count; ++i) {
+            for (uint32_t j = 0; j < docs[i].source_len; ++j) {
+                uint32_t const line = docs[i].source_start + j;
+                char const* const start = line_start(&f, line);
+                size_t const len = (size_t)(line_end(&f, line) - start);
+                if (escape) {
+                    html_write_line(job->outs, start, len);
+                }
+                else {
+                    sink_write_line(job->outs, start, len);
+                }
+            }
+        }
+        *(escape ? &p->escape : &p->source) += now() - t;
+    }
+
+    c->files += 1;
+    c->bytes += text.size;
+    c->lines += f.line_count;
+    c->docs += doc_count;
+
+    arena_reset(job->arena);
+    free_text(text);
+    fclose(fp);
+}
+
+static void
+print_result(
+    char const* dir,
+    char const* format,
+    int repeat,
+    struct phases const* best,
+    struct counts const* c)
+{
+    char const* name = strrchr(dir, '/');
+    name = name == NULL ? dir : name + 1;
+    printf("  {\"corpus\": \"%s\", \"format\": \"%s\", ", name, format);
+    printf("\"repeat\": %d,\n", repeat);
+    printf(
+        "   \"files\": %zu, \"bytes\": %zu, \"lines\": %zu, \"docs\": %zu,\n",
+        c->files,
+        c->bytes,
+        c->lines,
+        c->docs);
+    printf(
+        "   \"seconds\": {\"read_text_file\": %.6f, \"text_to_lines\": %.6f, "
+        "\"scan\": %.6f,\n",
+        best->read,
+        best->lines,
+        best->scan);
+    printf(
+        "               \"parse_doc\": %.6f, \"print_doc\": %.6f, "
+        "\"total\": %.6f,\n",
+        best->parse,
+        best->print,
+        best->total);
+    printf(
+        "               \"write_source\": %.6f, \"escape_source\": %.6f},\n",
+        best->source,
+        best->escape);
+    printf(
+        "   \"mb_per_second\": %.1f}",
+        best->total > 0 ? (double)c->bytes / best->total / 1e6 : 0.0);
+}
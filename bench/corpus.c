@@ -0,0 +1,288 @@
+/*!
+ * @file corpus.c
+ * Generator of synthetic C source corpora for benchmarking cdoc.
+ * @license 0BSD
+ */
+
+#define _POSIX_C_SOURCE 200809L
+
+#include <errno.h>
+#include <stdarg.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <sys/stat.h>
+
+/*!
+ * @struct shape
+ * Parameters describing one corpus.
+ */
+struct shape
+{
+    /*! @member name
+     * Name of the directory holding the files of this corpus.
+     */
+    char const* name;
+    /*! @member files
+     * Number of source files in the corpus.
+     */
+    int files;
+    /*! @member docs
+     * Number of docs in each file, before scaling.
+     */
+    int docs;
+    /*! @member sections
+     * Number of sections in each doc.
+     */
+    int sections;
+    /*! @member filler
+     * Number of undocumented lines of code between consecutive docs,
+     * controlling the density of doc comments.
+     */
+    int filler;
+    /*! @member macro_lines
+     * Number of continuation lines in each documented macro.
+     */
+    int macro_lines;
+    /*! @member nesting
+     * Depth of nested struct definitions in each documented struct.
+     */
+    int nesting;
+};
+
+// clang-format off
+static struct shape const shapes[] = {
+    /* name             files  docs  sections  filler  macro  nesting */
+    {"small-files",     1000,     8,        3,      2,     2,       1},
+    {"huge-file",          1, 20000,        3,      2,     2,       1},
+    {"sparse",            10,   400,        2,     60,     2,       1},
+    {"dense",             10,  4000,        1,      0,     1,       1},
+    {"many-sections",     10,   800,       24,      2,     2,       1},
+    {"long-macros",       10,   800,        2,      2,    64,       1},
+    {"deep-nesting",      10,   300,        2,      2,     2,      24},
+};
+// clang-format on
+
+/*!
+ * @function usage
+ * Print usage information and exit.
+ */
+static void
+usage(void);
+/*!
+ * @function errorf
+ * Write a formatted error message and exit with EXIT_FAILURE status.
+ */
+static void
+errorf(char const* fmt, ...);
+/*!
+ * @function make_dir
+ * Create the directory at path unless it already exists.
+ */
+static void
+make_dir(char const* path);
+/*!
+ * @function write_file
+ * Write file number index of the corpus with the provided shape to path.
+ * @param docs
+ * Number of docs in the file after scaling.
+ */
+static void
+write_file(char const* path, struct shape const* shape, int index, int docs);
+/*!
+ * @function write_function
+ * Write documented function number i to fp, alternating between
+ * prototypes and definitions.
+ */
+static void
+write_function(FILE* fp, struct shape const* shape, int i);
+/*!
+ * @function write_struct
+ * Write documented struct number i to fp, nested shape->nesting deep with a
+ * documented member at each level.
+ */
+static void
+write_struct(FILE* fp, struct shape const* shape, int i);
+/*!
+ * @function write_macro
+ * Write documented macro number i to fp, continued over shape->macro_lines
+ * lines.
+ */
+static void
+write_macro(FILE* fp, struct shape const* shape, int i);
+
+int
+main(int argc, char** argv)
+{
+    int scale = 1;
+    char const* dir = NULL;
+    for (int i = 1; i < argc; ++i) {
+        if (strcmp(argv[i], "--help") == 0) {
+            usage();
+        }
+        else if (strcmp(argv[i], "-s") == 0 && i + 1 < argc) {
+            scale = atoi(argv[++i]);
+            if (scale < 1) {
+                errorf("Invalid scale '%s'", argv[i]);
+            }
+        }
+        else if (dir == NULL) {
+            dir = argv[i];
+        }
+        else {
+            usage();
+        }
+    }
+    if (dir == NULL) {
+        usage();
+    }
+
+    make_dir(dir);
+    size_t const count = sizeof(shapes) / sizeof(shapes[0]);
+    for (size_t i = 0; i < count; ++i) {
+        struct shape const* const shape = &shapes[i];
+        char path[4096];
+        snprintf(path, sizeof(path), "%s/%s", dir, shape->name);
+        make_dir(path);
+        for (int f = 0; f < shape->files; ++f) {
+            snprintf(path, sizeof(path), "%s/%s/f%04d.c", dir, shape->name, f);
+            write_file(path, shape, f, shape->docs * scale);
+        }
+    }
+    return EXIT_SUCCESS;
+}
+
+static void
+usage(void)
+{
+    // clang-format off
+    puts(
+        "Usage: corpus [-s SCALE] DIR"                              "\n"
+                                                                    "\n"
+        "Write one directory of synthetic C sources per corpus"     "\n"
+        "shape to DIR, with SCALE times the default number of docs" "\n"
+        "per file."                                                 "\n"
+    );
+    // clang-format on
+    exit(EXIT_SUCCESS);
+}
+
+static void
+errorf(char const* fmt, ...)
+{
+    va_list args;
+    va_start(args, fmt);
+    fputs("error: ", stderr);
+    vfprintf(stderr, fmt, args);
+    fputs("\n", stderr);
+    va_end(args);
+    exit(EXIT_FAILURE);
+}
+
+static void
+make_dir(char const* path)
+{
+    if (mkdir(path, 0777) != 0 && errno != EEXIST) {
+        errorf("%s: %s", path, strerror(errno));
+    }
+}
+
+static void
+write_file(char const* path, struct shape const* shape, int index, int docs)
+{
+    FILE* const fp = fopen(path, "w");
+    if (fp == NULL) {
+        errorf("%s: %s", path, strerror(errno));
+    }
+
+    fprintf(fp, "/*!\n * @file f%04d.c\n", index);
+    fprintf(fp, " * Synthetic %s corpus file.\n */\n\n", shape->name);
+    fputs("#include <stddef.h>\n\n", fp);
+    for (int i = 0; i < docs; ++i) {
+        for (int j = 0; j < shape->filler; ++j) {
+            fprintf(fp, "static int filler_%d_%d = %d;\n", i, j, i + j);
+        }
+        switch (i % 3) {
+        case 0:
+            write_function(fp, shape, i);
+            break;
+        case 1:
+            write_struct(fp, shape, i);
+            break;
+        default:
+            write_macro(fp, shape, i);
+            break;
+        }
+        fputs("\n", fp);
+    }
+
+    if (fclose(fp) != 0) {
+        errorf("%s: %s", path, strerror(errno));
+    }
+}
+
+static void
+write_function(FILE* fp, struct shape const* shape, int i)
+{
+    fprintf(fp, "/*!\n * @function function_%d\n", i);
+    fputs(" * Compute a value from the provided parameters.\n", fp);
+    fputs(" * The result depends on every parameter.\n", fp);
+    for (int s = 1; s < shape->sections; ++s) {
+        fprintf(fp, " * @param p%d\n * Parameter number %d.\n", s, s);
+    }
+    fputs(" */\nint\n", fp);
+    fprintf(fp, "function_%d(", i);
+    for (int s = 1; s < shape->sections; ++s) {
+        fprintf(fp, "%sint p%d", s == 1 ? "" : ", ", s);
+    }
+    if (shape->sections <= 1) {
+        fputs("void", fp);
+    }
+    if (i % 2 == 0) {
+        fputs(");\n", fp);
+    }
+    else {
+        fputs(")\n{\n    return 0;\n}\n", fp);
+    }
+}
+
+static void
+write_struct(FILE* fp, struct shape const* shape, int i)
+{
+    fprintf(fp, "/*!\n * @struct struct_%d\n", i);
+    fputs(" * A record of synthetic data.\n", fp);
+    for (int s = 1; s < shape->sections; ++s) {
+        fprintf(fp, " * @note\n * Note number %d about this struct.\n", s);
+    }
+    fprintf(fp, " */\nstruct struct_%d\n{\n", i);
+    for (int d = 0; d < shape->nesting; ++d) {
+        int const indent = 4 * (d + 1);
+        fprintf(fp, "%*s/*! @member m%d\n", indent, "", d);
+        fprintf(fp, "%*s * Member at depth %d.\n", indent, "", d);
+        fprintf(fp, "%*s */\n", indent, "");
+        fprintf(fp, "%*sint m%d;\n", indent, "", d);
+        if (d + 1 < shape->nesting) {
+            fprintf(fp, "%*sstruct\n%*s{\n", indent, "", indent, "");
+        }
+    }
+    for (int d = shape->nesting - 1; d > 0; --d) {
+        fprintf(fp, "%*s} n%d;\n", 4 * d, "", d);
+    }
+    fputs("};\n", fp);
+}
+
+static void
+write_macro(FILE* fp, struct shape const* shape, int i)
+{
+    fprintf(fp, "/*!\n * @macro MACRO_%d\n", i);
+    fputs(" * Expand to an expression of x.\n", fp);
+    for (int s = 1; s < shape->sections; ++s) {
+        fprintf(fp, " * @note\n * Note number %d about this macro.\n", s);
+    }
+    fprintf(fp, " */\n#define MACRO_%d(x) \\\n", i);
+    for (int l = 0; l < shape->macro_lines; ++l) {
+        fprintf(fp, "    ((x) + %d) * \\\n", l);
+    }
+    fputs("    1\n", fp);
+}
@@ -3,16 +3,72 @@
  * @license 0BSD
  */
 
+#define _POSIX_C_SOURCE 200809L
+// For the d_type member of struct dirent on glibc and musl.
+#define _DEFAULT_SOURCE
+
+#include <errno.h>
+#include <inttypes.h>
 #include <stdarg.h>
 #include <stdbool.h>
+#include <stdint.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
+#include <time.h>
+
+#include <dirent.h>
+#include <fcntl.h>
+#include <fnmatch.h>
+#include <poll.h>
+#include <pthread.h>
+#include <sys/mman.h>
+#include <sys/resource.h>
+#include <sys/stat.h>
+#include <sys/uio.h>
+#include <unistd.h>
+#if defined(__linux__)
+#    include <sys/inotify.h>
+#endif
+
+#include "cdoc.h"
+
+// libcdoc is built with -DCDOC_NO_MAIN, which leaves out main and the code
+// that only the command line uses: the renderers, the walk of the inputs,
+// the worker pool, the cache, and the watch.
+
+// Build with -DCDOC_NO_SIMD to use the portable scanner on every target.
+// AVX2 is chosen at runtime, in place of SSE2.
+#if !defined(CDOC_NO_SIMD)
+#    if defined(__SSE2__)
+#        include <emmintrin.h>
+#        define HAVE_SSE2_SCAN
+#    endif
+#    if defined(__SSE2__) && defined(__GNUC__) \
+        && (defined(__x86_64__) || defined(__i386__))
+#        include <immintrin.h>
+#        define HAVE_AVX2_SCAN
+#    endif
+#    if defined(__ARM_NEON) && defined(__aarch64__)
+#        include <arm_neon.h>
+#        define HAVE_NEON_SCAN
+#    endif
+#endif
 
 #define VERSION "0.3a"
 
-static bool markdown_output = false;
+/*!
+ * @macro ALWAYS_INLINE
+ * Function specifier asking the compiler to inline every call, which
+ * compilers other than GCC and Clang take as a hint.
+ */
+#if defined(__GNUC__)
+#    define ALWAYS_INLINE __attribute__((always_inline)) inline
+#else
+#    define ALWAYS_INLINE inline
+#endif
 
+#if !defined(CDOC_NO_MAIN)
 /*!
  * @function usage
  * Print usage information and exit.
@@ -25,17 +81,15 @@ usage(void);
  */
 static void
 version(void);
+#endif
 
 /*!
  * @macro LINENO
- * Calculates a 1-indexed line number from the pointer offset of two
- * pointers to lines in the file.
- * @param start
- * Starting line of the file.
- * @param cur
- * Some line in the file.
+ * Calculates a 1-indexed line number from a 0-indexed line index.
+ * @param line
+ * Index of some line in the file.
  */
-#define LINENO(/* char** */ start, /* char** */ cur) ((int)(cur - start + 1))
+#define LINENO(/* uint32_t */ line) ((int)(line) + 1)
 
 /*!
  * @function errorf
@@ -63,678 +117,8768 @@ errorf(char const* fmt, ...);
  */
 static void*
 xalloc(void* ptr, size_t size);
+
 /*!
- * @function read_text_file
- * Returns the contents of stream as a NUL-terminated heap-allocated
- * cstring.
- * Encountering a NUL-byte or read failure will print an error message and
- * terminate the program with EXIT_FAILURE status.
+ * @macro ARENA_ALIGN
+ * Alignment in bytes of every allocation returned from an arena.
  */
-static char*
-read_text_file(FILE* stream);
+#define ARENA_ALIGN 16
 /*!
- * @function text_to_lines
- * Transform provided NUL-terminated text string into a heap-allocated
- * NULL-terminated list of NUL-terminated cstrings by replacing newline
- * characters with NUL bytes.
- * @note
- * This function modifies text in place.
+ * @macro ARENA_MIN_BLOCK
+ * Minimum size in bytes of a block allocated by an arena.
  */
-static char**
-text_to_lines(char* text);
+#define ARENA_MIN_BLOCK (64 * 1024)
+
 /*!
- * @function is_hspace
- * Returns true if c is a horizontal whitespace character.
- * The characters '\t', '\r', and ' ' are considered horizontal whitespace.
+ * @struct arena_block
+ * A contiguous region of memory from which arena allocations are carved.
  */
-static bool
-is_hspace(int c);
+struct arena_block
+{
+    /*! @member prev
+     * Previously allocated block of the arena, or NULL.
+     */
+    struct arena_block* prev;
+    /*! @member size
+     * Number of usable bytes following the block header.
+     */
+    size_t size;
+    /*! @member used
+     * Number of bytes handed out from this block.
+     */
+    size_t used;
+};
 /*!
- * @function is_doc_comment
- * Returns true if the first non-whitespace characters of a line
- * are "/\*!", the start of a doc-comment.
- * @param line
- * NUL-terminated character string.
+ * @macro ARENA_HEADER_SIZE
+ * Size of an arena_block header rounded up to ARENA_ALIGN.
+ * The usable bytes of a block begin this many bytes after its header.
  */
-static bool
-is_doc_comment(char const* line);
+#define ARENA_HEADER_SIZE                                                      \
+    ((sizeof(struct arena_block) + ARENA_ALIGN - 1)                            \
+     & ~(size_t)(ARENA_ALIGN - 1))
+
 /*!
- * @function clean_doc_line
- * Returns a pointer to the start of the actual content within a doc
- * comment line, skipping leading whitespace and the optional '*'.
+ * @struct arena
+ * Bump allocator for the parse structures of a single file.
+ * Allocations are never freed individually; all memory handed out by an
+ * arena is released at once by arena_reset, which keeps the most recent
+ * block around for reuse by the next file.
  */
-static char*
-clean_doc_line(char* line);
+struct arena
+{
+    /*! @member block
+     * Block from which allocations are currently made, or NULL.
+     */
+    struct arena_block* block;
+    /*! @member last
+     * Most recent allocation, which arena_grow may extend in place.
+     */
+    void* last;
+    /*! @member allocations
+     * Number of allocations made from this arena since it was created,
+     * counting each move of a grown allocation.
+     */
+    uint64_t allocations;
+    /*! @member size
+     * Number of bytes held by the blocks of this arena, headers included.
+     */
+    size_t size;
+};
 
 /*!
- * @function do_file
- * Generate documentation for the provided file.
- * @param fp
- * File pointer returned from fopen.
- * The position fp's file offset should be at the beginning of the file.
+ * @function arena_alloc
+ * Returns a pointer to size bytes of uninitialized memory allocated from a.
+ * Allocation failure will print an error message and terminate the program
+ * with EXIT_FAILURE status.
+ */
+static void*
+arena_alloc(struct arena* a, size_t size);
+/*!
+ * @function arena_grow
+ * Resize the allocation ptr of old_size bytes to new_size bytes, returning
+ * the possibly moved allocation.
+ * The most recent allocation of an arena is extended in place when the
+ * current block has room; other allocations are copied.
+ */
+static void*
+arena_grow(struct arena* a, void* ptr, size_t old_size, size_t new_size);
+/*!
+ * @function arena_push
+ * Make room for one more element at index count in the array ptr of
+ * *capacity elements of elem_size bytes, returning the possibly moved
+ * array.
+ * The capacity is doubled each time the array is full.
+ * A NULL ptr with a *capacity of zero starts a new array.
+ */
+static void*
+arena_push(
+    struct arena* a,
+    void* ptr,
+    size_t* capacity,
+    size_t count,
+    size_t elem_size);
+#if !defined(CDOC_NO_MAIN)
+/*!
+ * @function arena_used
+ * Returns the number of bytes handed out by a since it was last reset,
+ * rounded up to ARENA_ALIGN but without the unused remainder of its blocks.
+ */
+static size_t
+arena_used(struct arena const* a);
+#endif
+/*!
+ * @function arena_reset
+ * Release every allocation made from a.
+ * The most recent block is kept so that later allocations can reuse it.
+ */
+static void
+arena_reset(struct arena* a);
+/*!
+ * @function arena_free
+ * Release every allocation and block of a.
  */
 static void
-do_file(FILE* fp);
+arena_free(struct arena* a);
 
+#if !defined(CDOC_NO_MAIN)
 /*!
- * @struct doc
- * Representation of a document, aka a list of doc-sections documenting the
- * a single portion of a C source file.
- *
- * The cdoc documentation:
- * <pre><code>
- * /\*!
- * * @struct foo
- * * The struct used for fooing.
- * * @note
- * * Be careful not to bar this foo.
- * *\/
- * struct foo
- * {
- * int some_member;
- * };
- * </code></pre>
- * is comprised of two sections (beginning with @struct and @note) and
- * four lines of source.
+ * @macro SINK_BUFFER_SIZE
+ * Size in bytes of the write buffer of a sink backed by a file descriptor.
  */
-struct doc
+#define SINK_BUFFER_SIZE (64 * 1024)
+
+/*!
+ * @struct sink
+ * Buffered destination for generated documentation.
+ * A sink either flushes to a file descriptor (a file, pipe, or socket) with
+ * direct write(2) calls, bypassing stdio, or collects all output in a
+ * growable memory buffer.
+ */
+struct sink
 {
-    /*! @member sections
-     * Dynamically allocated list of sections in this doc.
+    /*! @member fd
+     * File descriptor to which buffered output is flushed, or -1 if the sink
+     * collects its output in memory.
      */
-    struct section* sections;
-    /*! @member section_count
-     * Number of sections in this doc.
+    int fd;
+    /*! @member buf
+     * Buffered output not yet flushed to fd.
      */
-    size_t section_count;
-    /*! @member source
-     * Dynamically allocated NULL-terminated list of source code associated
-     * with this doc.
-     * A value of NULL implies that this doc has no associated source code.
+    char* buf;
+    /*! @member size
+     * Number of bytes in buf.
+     */
+    size_t size;
+    /*! @member cap
+     * Capacity of buf in bytes.
+     */
+    size_t cap;
+    /*! @member error
+     * The errno value of the first failed write to fd, or zero.
+     * Output written after a failure is discarded.
      */
-    char** source;
+    int error;
+    /*! @member total
+     * Number of bytes written to the sink since it was initialized.
+     */
+    uint64_t total;
 };
+
 /*!
- * @struct section
- * Representation of a portion of a document, specifically one facet of the
- * subject of the doc.
- * Each section has a mandatory tag, an optional name, and optional body
- * of description text.
- * The doc-lines:
- * <pre><code>
- * /\*!
- * * @struct foo
- * * The struct used for fooing.
- * *\/
- * </code></pre>
- * form one section with the tag "struct", the name "foo" and a text body
- * containing the single line of text "The struct used for fooing.".
+ * @function sink_init_fd
+ * Initialize s to flush its output to the file descriptor fd.
  */
-struct section
+static void
+sink_init_fd(struct sink* s, int fd);
+/*!
+ * @function sink_init_memory
+ * Initialize s to collect its output in memory.
+ */
+static void
+sink_init_memory(struct sink* s);
+/*!
+ * @function sink_write
+ * Write size bytes of data to s.
+ * Always inlined, so that data that fits in the buffer is copied without a
+ * call, by a few moves when size is a constant.
+ */
+static ALWAYS_INLINE void
+sink_write(struct sink* s, char const* data, size_t size);
+/*!
+ * @function sink_write_slow
+ * Write size bytes of data that do not fit in the buffer to s, growing the
+ * buffer of a memory sink.
+ * Data that does not fit in the buffer of a file descriptor sink is
+ * written together with the buffered output in a single writev(2) call.
+ */
+static void
+sink_write_slow(struct sink* s, char const* data, size_t size);
+/*!
+ * @function sink_puts
+ * Write the NUL-terminated string str to s.
+ */
+static void
+sink_puts(struct sink* s, char const* str);
+/*!
+ * @macro SINK_LITERAL
+ * Write the string literal str to s, its length being known at compile
+ * time.
+ */
+#define SINK_LITERAL(/* struct sink* */ s, str)                               \
+    sink_write((s), "" str, sizeof(str) - 1)
+/*!
+ * @function sink_write_line
+ * Write size bytes of data followed by a newline character to s.
+ */
+static void
+sink_write_line(struct sink* s, char const* data, size_t size);
+/*!
+ * @function sink_write_varint
+ * Write value to s as a LEB128 varint: seven bits per byte, least
+ * significant first, with the high bit set on every byte but the last.
+ */
+static void
+sink_write_varint(struct sink* s, uint64_t value);
+/*!
+ * @function sink_flush
+ * Write the buffered output of a file descriptor sink to its file
+ * descriptor.
+ * Does nothing for a memory sink.
+ */
+static void
+sink_flush(struct sink* s);
+/*!
+ * @function sink_writev
+ * Write every byte described by the count entries of iov to s->fd,
+ * retrying short and interrupted writes.
+ * Failure is recorded in s->error.
+ * @note
+ * The entries of iov are modified.
+ */
+static void
+sink_writev(struct sink* s, struct iovec* iov, int count);
+/*!
+ * @function sink_free
+ * Release the buffer of s without flushing it.
+ */
+static void
+sink_free(struct sink* s);
+#endif
+
+/*!
+ * @enum tag
+ * Identifier of a known doc-section tag, resolved once by find_tag when
+ * the section is parsed.
+ */
+enum tag
 {
-    /*! @member tag_start
-     * Location of the first character in the tag slice.
+    TAG_UNKNOWN,
+    TAG_FILE,
+    TAG_LICENSE,
+    TAG_FUNCTION,
+    TAG_PARAM,
+    TAG_RETURN,
+    TAG_MACRO,
+    TAG_STRUCT,
+    TAG_UNION,
+    TAG_ENUM,
+    TAG_TYPEDEF,
+    TAG_VARIABLE,
+    TAG_MEMBER,
+    TAG_NOTE,
+    TAG_TODO,
+    TAG_SEE,
+};
+
+/*!
+ * @function find_tag
+ * Returns the identifier of the tag of len bytes at tag, or TAG_UNKNOWN.
+ * The length and first character select at most one candidate, so a
+ * single comparison is made.
+ */
+static enum tag
+find_tag(char const* tag, size_t len);
+
+/*!
+ * @struct tag_pattern
+ * A tag named by a filter option, matching sections with that tag.
+ */
+struct tag_pattern
+{
+    /*! @member str
+     * The tag as given on the command line, without the '@'.
      */
-    char const* tag_start;
-    /*! @member tag_len
-     * Length of the tag slice.
+    char const* str;
+    /*! @member len
+     * Length of str.
+     */
+    size_t len;
+    /*! @member tag
+     * Identifier of the tag, so that known tags are matched by comparing
+     * integers.
      */
-    int tag_len;
+    enum tag tag;
+};
 
-    /*! @member name_start
-     * Location of the first character in the name slice.
+/*!
+ * @struct target
+ * A destination for the documentation of every input file in one output
+ * format.
+ */
+struct target
+{
+    /*! @member renderer
+     * Output format of the documentation written to this target.
      */
-    char const* name_start;
-    /*! @member name_len
-     * Length of the name slice.
-     * A length of zero implies that this tag has no name.
+    struct renderer const* renderer;
+    /*! @member path
+     * Path of the file to which documentation is written, or "-" for
+     * standard output.
+     * A value of NULL implies that output is collected in memory.
      */
-    int name_len;
+    char const* path;
+    /*! @member per_file
+     * True if the documentation of each input file is written to a file of
+     * its own below options->output_dir, in which case path is NULL.
+     */
+    bool per_file;
+};
 
-    /*! @member text_start
-     * Location of the first line in the text body.
+/*!
+ * @struct options
+ * Command line options shared by every job.
+ */
+struct options
+{
+    /*! @member targets
+     * List of destinations to which the documentation of each file is
+     * written.
+     * Every file is parsed once and rendered to each target in turn.
      */
-    char** text_start;
-    /*! @member text_len
-     * Length of the text body.
-     * A length of zero implies that this tag has no body.
+    struct target* targets;
+    /*! @member target_count
+     * Number of targets in the list.
+     */
+    size_t target_count;
+    /*! @member jobs
+     * Maximum number of files processed concurrently.
+     */
+    int jobs;
+    /*! @member cache_dir
+     * Directory holding the rendered output of previously processed files,
+     * or NULL if no cache is used.
+     */
+    char const* cache_dir;
+    /*! @member stream
+     * Parse standard input incrementally, writing each doc as soon as it is
+     * complete instead of after the whole stream has been read.
+     */
+    bool stream;
+    /*! @member stats
+     * Report counters and phase timings of each file to stderr.
+     */
+    bool stats;
+    /*! @member keep_going
+     * Report errors and continue instead of exiting at the first error.
+     * A doc with an error is skipped, as is a file that cannot be opened or
+     * read.
+     */
+    bool keep_going;
+    /*! @member watch_dir
+     * Directory whose C source and header files are documented again
+     * whenever they change, or NULL to process the command line files once.
+     */
+    char const* watch_dir;
+    /*! @member emit_ir
+     * Path of the file to which the parsed docs of every input file are
+     * written in the IR format, or NULL.
+     * The IR of each file is collected through the element of targets that
+     * uses ir_renderer.
+     */
+    char const* emit_ir;
+    /*! @member from_ir
+     * List of the paths of IR files whose docs are rendered one file after
+     * the other in place of reading input files.
+     * An empty list reads input files.
+     */
+    char const** from_ir;
+    /*! @member from_ir_count
+     * Number of paths in from_ir.
+     */
+    size_t from_ir_count;
+    /*! @member output_dir
+     * Directory below which the documentation of each input file is
+     * written to a file of its own, or NULL.
+     */
+    char const* output_dir;
+    /*! @member output_mode
+     * Permissions of the files written below output_dir.
+     */
+    mode_t output_mode;
+    /*! @member index_path
+     * Path of the file to which the symbol index of every input file is
+     * written, or NULL if no index is generated.
+     * The names defined and referenced by each file are collected through
+     * the last element of targets, which uses symbol_renderer.
+     */
+    char const* index_path;
+    /*! @member search_index
+     * Path of the file to which the search index of every input file is
+     * written, or NULL if no search index is generated.
+     * The tokens of each file are collected through the element of targets
+     * that uses search_renderer.
+     */
+    char const* search_index;
+    /*! @member highlight
+     * Render the source of HTML targets with html_highlight_renderer.
+     */
+    bool highlight;
+    /*! @member only
+     * Heap-allocated list of tags, one of which must be the tag of the first
+     * section of a doc for the doc to be rendered.
+     * An empty list selects every tag.
+     */
+    struct tag_pattern* only;
+    /*! @member only_count
+     * Number of tags in only.
+     */
+    size_t only_count;
+    /*! @member exclude_tags
+     * Heap-allocated list of tags, none of which may be the tag of any
+     * section of a doc for the doc to be rendered.
+     */
+    struct tag_pattern* exclude_tags;
+    /*! @member exclude_tag_count
+     * Number of tags in exclude_tags.
+     */
+    size_t exclude_tag_count;
+    /*! @member names
+     * Heap-allocated list of fnmatch(3) patterns, one of which must match
+     * the name of the first section of a doc for the doc to be rendered.
+     * An empty list selects every name.
+     */
+    char const** names;
+    /*! @member name_count
+     * Number of patterns in names.
+     */
+    size_t name_count;
+    /*! @member exclude_names
+     * Heap-allocated list of fnmatch(3) patterns, none of which may match the
+     * name of the first section of a doc for the doc to be rendered.
+     */
+    char const** exclude_names;
+    /*! @member exclude_name_count
+     * Number of patterns in exclude_names.
+     */
+    size_t exclude_name_count;
+    /*! @member max_memory
+     * Maximum number of bytes of input and parse structures held while
+     * documenting a file, or zero for no limit.
+     * A non-zero limit parses every input as a stream.
+     */
+    size_t max_memory;
+    /*! @member includes
+     * Heap-allocated list of fnmatch(3) patterns, one of which must match a
+     * file found under a -r directory for the file to be documented.
+     * An empty list selects C source and header files.
+     */
+    char const** includes;
+    /*! @member include_count
+     * Number of patterns in includes.
+     */
+    size_t include_count;
+    /*! @member excludes
+     * Heap-allocated list of fnmatch(3) patterns, none of which may match a
+     * file or directory found under a -r directory for it to be
+     * documented.
      */
-    int text_len;
+    char const** excludes;
+    /*! @member exclude_count
+     * Number of patterns in excludes.
+     */
+    size_t exclude_count;
 };
 
 /*!
- * @function parse_struct_source
- * Parse the lines of a struct forward declaration or definition using the
- * provided parse state.
- * @note
- * The method used for parsing in this function happens to work for
- * struct, union, enum, typedef, and variable declarations.
- * @todo
- * Currently this function does not handle comments (C or C++)
- * correctly which may lead to erroneous parsing.
- * This function should be modified to correctly handle comments.
+ * @function add_tag_patterns
+ * Append each tag of the comma-separated list to the list of *count
+ * patterns at *patterns.
+ * The list is modified in place so that each tag is NUL-terminated.
  */
-static char**
-parse_struct_source(char*** linepp);
+static void
+add_tag_patterns(char* list, struct tag_pattern** patterns, size_t* count);
 /*!
- * @function parse_function_source
- * Parse the lines of a function prototype or definition using the provided
- * parse state.
+ * @function add_name_pattern
+ * Append a glob to the list of *count patterns at *patterns.
  */
-static char**
-parse_function_source(char*** linepp);
+static void
+add_name_pattern(char const* glob, char const*** patterns, size_t* count);
+#if !defined(CDOC_NO_MAIN)
 /*!
- * @function parse_macro_source
- * Parse the lines of a preprocessor macro using the provided parse state.
+ * @function parse_size
+ * Parse a number of bytes with an optional K, M, or G suffix, each 1024
+ * times the previous, into *size.
+ * Returns false if str is not such a number or does not fit a size_t.
  */
-static char**
-parse_macro_source(char*** linepp);
+static bool
+parse_size(char const* str, size_t* size);
+#endif
+
 /*!
- * @function parse_doc
- * Construct and return a doc from the provided parse state parameters.
+ * @struct stats
+ * Counters and phase timings of the files processed by one or more jobs.
+ * Timings are only collected when options->stats is set.
  */
-static struct doc
-parse_doc(char* const* lines_begin, char*** linepp);
+struct stats
+{
+    /*! @member files
+     * Number of files processed.
+     */
+    uint64_t files;
+    /*! @member bytes
+     * Number of bytes of input read.
+     */
+    uint64_t bytes;
+    /*! @member lines
+     * Number of lines of input indexed.
+     */
+    uint64_t lines;
+    /*! @member docs
+     * Number of docs parsed.
+     */
+    uint64_t docs;
+    /*! @member sections
+     * Number of sections parsed.
+     */
+    uint64_t sections;
+    /*! @member source_lines
+     * Number of lines of source code captured by docs.
+     */
+    uint64_t source_lines;
+    /*! @member allocations
+     * Number of arena allocations made.
+     */
+    uint64_t allocations;
+    /*! @member output_bytes
+     * Number of bytes of documentation written, summed over every target.
+     */
+    uint64_t output_bytes;
+    /*! @member errors
+     * Number of errors reported.
+     */
+    uint64_t errors;
+    /*! @member failed_files
+     * Number of files with at least one error.
+     */
+    uint64_t failed_files;
+    /*! @member read
+     * Seconds spent reading input, including hashing input for the cache.
+     */
+    double read;
+    /*! @member split
+     * Seconds spent building line indices with text_to_lines.
+     */
+    double split;
+    /*! @member parse
+     * Seconds spent parsing docs.
+     */
+    double parse;
+    /*! @member render
+     * Seconds spent rendering docs.
+     */
+    double render;
+    /*! @member memory
+     * Largest number of bytes of input and parse structures held at once,
+     * not counting memory-mapped input.
+     */
+    uint64_t memory;
+    /*! @member peak_rss
+     * Peak resident set size of the process in bytes, or zero if not
+     * measured.
+     * Only measured for the totals of a run.
+     */
+    uint64_t peak_rss;
+};
+
+#if !defined(CDOC_NO_MAIN)
 /*!
- * @function print_doc
- * Print a formatted representation of this doc to stdout.
+ * @function add_stats
+ * Add every counter and timing of from to to.
  */
 static void
-print_doc(struct doc const d);
+add_stats(struct stats* to, struct stats const* from);
 /*!
- * @function parse_section
- * Construct and return a section from the provided parse state parameters.
+ * @function peak_rss
+ * Returns the peak resident set size of the process in bytes, or zero if
+ * it cannot be measured.
  */
-static struct section
-parse_section(char* const* lines_begin, char* line, char*** text_body_p);
+static uint64_t
+peak_rss(void);
 /*!
- * @function print_section
- * Print a formatted representation of this section stdout.
+ * @function print_stats
+ * Write stats to stderr as a line of key=value pairs following label.
  */
 static void
-print_section(struct section const s);
-
-int
-main(int argc, char** argv)
+print_stats(char const* label, struct stats const* stats);
+#endif
+/*!
+ * @struct job
+ * Context for generating the documentation of a single input file.
+ * Jobs share no mutable state, so the jobs of different files may run
+ * concurrently.
+ */
+struct job
 {
-    bool parse_options = true;
-    for (int i = 1; i < argc; ++i) {
-        char const* const arg = argv[i];
-        if (parse_options && strcmp(arg, "--help") == 0) {
-            usage();
-        }
-        if (parse_options && strcmp(arg, "--version") == 0) {
-            version();
-        }
-        if (parse_options && strcmp(arg, "--md") == 0) {
-            markdown_output = true;
-            continue;
-        }
-        if (parse_options && strcmp(arg, "--") == 0) {
-            parse_options = false;
+    /*! @member options
+     * Options used when generating documentation for this file.
+     */
+    struct options const* options;
+    /*! @member path
+     * Path of the input file, or "-" for standard input.
+     */
+    char const* path;
+    /*! @member outs
+     * Sinks to which the documentation of this file is written, one for
+     * each element of options->targets.
+     */
+    struct sink* outs;
+    /*! @member arena
+     * Arena holding the parse structures of this file.
+     * The arena is reset once the file has been processed, so an arena may
+     * be shared by jobs that do not run concurrently.
+     */
+    struct arena* arena;
+    /*! @member errors
+     * Heap-allocated list of heap-allocated messages describing the errors
+     * encountered while processing this file, in the order encountered.
+     */
+    char** errors;
+    /*! @member error_count
+     * Number of errors in the list.
+     * A value of zero implies that no error has occurred.
+     */
+    size_t error_count;
+    /*! @member open_errno
+     * The errno value set when the input file failed to open, or zero.
+     */
+    int open_errno;
+    /*! @member stats
+     * Counters and timings of this file.
+     */
+    struct stats stats;
+
+    /*! @member buffers
+     * Heap-allocated memory sinks backing outs when the job is run by
+     * run_parallel.
+     */
+    struct sink* buffers;
+    /*! @member done
+     * True once a worker thread has finished with this job.
+     */
+    bool done;
+};
+
+/*!
+ * @function job_errorf
+ * Append a formatted error message to the errors of job and return false.
+ * @param fmt
+ * Printf-style format string.
+ * @param ...
+ * Format arguments.
+ */
+static bool
+job_errorf(struct job* job, char const* fmt, ...);
+/*!
+ * @function lap
+ * If options->stats is set, add the time elapsed since *start to *phase
+ * and set *start to the current time.
+ * The monotonic clock is only read when options->stats is set.
+ */
+static void
+lap(struct job* job, double* phase, double* start);
+/*!
+ * @function clock_seconds
+ * Returns the current time of the monotonic clock in seconds.
+ */
+static double
+clock_seconds(void);
+#if !defined(CDOC_NO_MAIN)
+/*!
+ * @function run_job
+ * Open the input file of job and generate its documentation to job->outs.
+ * Returns false if the file could not be opened or processed.
+ */
+static bool
+run_job(struct job* job);
+/*!
+ * @function finish_job
+ * Report the errors of a failed job and exit with EXIT_FAILURE status, or
+ * with options->keep_going, report the errors and return.
+ * Does nothing if job completed successfully.
+ * If options->stats is set, the stats of job are reported and added to
+ * totals first.
+ * @param outs
+ * Sinks holding the output of the jobs written before this one, which are
+ * flushed before the error is reported.
+ */
+static void
+finish_job(struct job* job, struct sink* outs, struct stats* totals);
+/*!
+ * @function write_file_outputs
+ * Write the output of job for each per_file target to its file below
+ * options->output_dir, and empty the sink of the target.
+ * Files are replaced atomically, so that a reader sees either the previous
+ * or the new documentation of the file.
+ * Returns false if a file could not be written.
+ */
+static bool
+write_file_outputs(struct job* job);
+/*!
+ * @function output_file_path
+ * Returns the heap-allocated path below options->output_dir of the
+ * documentation in the format of renderer of the input file at path.
+ * The path is the input path followed by a dot and the name of the format,
+ * leaving out leading slashes, empty components, and "." components.
+ * A component of two or more dots gets one more, so that the path stays
+ * below output_dir and different relative paths get different pages.
+ */
+static char*
+output_file_path(
+    struct options const* options,
+    char const* path,
+    struct renderer const* renderer);
+/*!
+ * @function make_parent_dirs
+ * Create each missing directory leading to path.
+ * Returns zero, or the errno value of the first directory that could not
+ * be created.
+ */
+static int
+make_parent_dirs(char* path);
+
+/*!
+ * @struct walk_entry
+ * File or directory to be documented, either named by an argument or found
+ * under a -r directory.
+ */
+struct walk_entry
+{
+    /*! @member path
+     * Heap-allocated path of the entry.
+     */
+    char* path;
+    /*! @member dir
+     * Heap-allocated directory at path, or NULL if the entry is a file.
+     */
+    struct walk_dir* dir;
+    /*! @member position
+     * Index of the entry among the entries yielded by the walk of every
+     * shard, set once the entry is yielded.
+     */
+    uint64_t position;
+};
+
+/*!
+ * @struct walk_dir
+ * Directory whose files are documented by a walk.
+ */
+struct walk_dir
+{
+    /*! @member path
+     * Path of the directory.
+     */
+    char const* path;
+    /*! @member rel
+     * Offset in the path of each entry of the directory at which the part of
+     * the path below the -r directory starts.
+     */
+    size_t rel;
+    /*! @member entries
+     * Heap-allocated list of entries sorted by path.
+     */
+    struct walk_entry* entries;
+    /*! @member entry_count
+     * Number of entries in the list.
+     */
+    size_t entry_count;
+    /*! @member error
+     * The errno value set when the directory failed to be listed, or zero.
+     */
+    int error;
+    /*! @member listed
+     * True once entries and error have been set by walk_list_dir.
+     */
+    bool listed;
+    /*! @member next
+     * Next directory in the pending list of the walk.
+     */
+    struct walk_dir* next;
+};
+
+/*!
+ * @struct walk_frame
+ * Position of a walk within one directory.
+ */
+struct walk_frame
+{
+    /*! @member entry
+     * Entry of the directory.
+     */
+    struct walk_entry* entry;
+    /*! @member index
+     * Index of the next entry of the directory to be visited.
+     */
+    size_t index;
+};
+
+/*!
+ * @macro MAX_SHARD_COUNT
+ * Largest number of shards accepted by --shard and by cdoc merge.
+ */
+#define MAX_SHARD_COUNT 65536
+/*!
+ * @struct walk
+ * Depth-first traversal of the FILE and -r DIR arguments, yielding files in
+ * argument order and the files of each directory sorted by path.
+ * Directories may be listed in any order, and on any thread, without
+ * changing the order in which files are yielded.
+ */
+struct walk
+{
+    /*! @member root
+     * Entry whose directory lists the arguments.
+     */
+    struct walk_entry root;
+    /*! @member args
+     * Directory listing the arguments, in argument order.
+     */
+    struct walk_dir args;
+    /*! @member stack
+     * Heap-allocated list of the directories being visited, innermost last.
+     * An empty stack marks the end of the walk.
+     */
+    struct walk_frame* stack;
+    /*! @member depth
+     * Number of directories in the stack.
+     */
+    size_t depth;
+    /*! @member stack_cap
+     * Capacity of the stack.
+     */
+    size_t stack_cap;
+    /*! @member pending
+     * List of directories yet to be listed, with the directory needed
+     * soonest first when listing proceeds one directory at a time.
+     */
+    struct walk_dir* pending;
+    /*! @member file_count
+     * Number of files yielded so far.
+     */
+    size_t file_count;
+    /*! @member yielded
+     * Heap-allocated list of the file_count entries yielded so far.
+     */
+    struct walk_entry const** yielded;
+    /*! @member position
+     * Number of entries that the walk of every shard has yielded so far.
+     */
+    uint64_t position;
+    /*! @member shard
+     * Index of the shard whose files are yielded, if shard_count is set.
+     */
+    size_t shard;
+    /*! @member shard_count
+     * Number of shards among which the files are partitioned, or zero to
+     * yield every file.
+     */
+    size_t shard_count;
+    /*! @member shard_loads
+     * Heap-allocated list of the number of bytes of the files assigned to
+     * each shard so far, or NULL to assign files by the hash of their path.
+     */
+    uint64_t* shard_loads;
+};
+
+/*!
+ * @function walk_add
+ * Append an argument to walk, to be documented as a file, or if recurse is
+ * set, as a directory whose files are documented.
+ * Must be called before walk_start.
+ */
+static void
+walk_add(struct walk* walk, char const* path, bool recurse);
+/*!
+ * @function walk_start
+ * Start the traversal of the arguments of walk.
+ */
+static void
+walk_start(struct walk* walk);
+/*!
+ * @function walk_next
+ * Returns the next file of walk, or a directory that failed to be listed.
+ * Returns NULL at the end of the walk, or when the next entry is in a
+ * directory that has not been listed yet.
+ */
+static struct walk_entry const*
+walk_next(struct walk* walk);
+/*!
+ * @function walk_list_dir
+ * List the files and subdirectories of dir that are selected by options,
+ * sorted by path.
+ * Touches no state shared with other directories, so that directories may
+ * be listed concurrently.
+ * Entries whose type is reported by readdir are not stat'ed.
+ */
+static void
+walk_list_dir(struct options const* options, struct walk_dir* dir);
+/*!
+ * @function walk_listed
+ * Mark dir, which was taken from the pending list of walk, as listed and
+ * add its subdirectories to the pending list.
+ */
+static void
+walk_listed(struct walk* walk, struct walk_dir* dir);
+/*!
+ * @function walk_in_shard
+ * Set the position of entry, a file or a directory that failed to be
+ * listed, and return true if it is assigned to the shard of walk.
+ * Every entry is visited in the same order by every shard, so that the
+ * assignment by size gives each entry to the same shard in every process.
+ */
+static bool
+walk_in_shard(struct walk* walk, struct walk_entry* entry);
+/*!
+ * @function walk_yield
+ * Append entry to the entries yielded by walk and return it.
+ */
+static struct walk_entry const*
+walk_yield(struct walk* walk, struct walk_entry* entry);
+/*!
+ * @function is_walked_name
+ * Returns true if options select the file or directory named name found
+ * under a -r directory, whose path below the -r directory is rel.
+ */
+static bool
+is_walked_name(
+    struct options const* options,
+    char const* name,
+    char const* rel,
+    bool is_dir);
+/*!
+ * @function match_walk_glob
+ * Returns true if glob matches rel when glob contains a slash, or name
+ * otherwise.
+ */
+static bool
+match_walk_glob(char const* glob, char const* name, char const* rel);
+/*!
+ * @function compare_walk_entries
+ * Comparison function for sorting walk entries by path with qsort.
+ */
+static int
+compare_walk_entries(void const* lhs, void const* rhs);
+/*!
+ * @function walk_free
+ * Free the entries of walk.
+ */
+static void
+walk_free(struct walk* walk);
+/*!
+ * @function walk_free_entries
+ * Free the entries of dir and their directories, recursively.
+ */
+static void
+walk_free_entries(struct walk_dir* dir);
+
+/*!
+ * @struct pool
+ * State shared between the worker threads and the sequencer of
+ * run_parallel.
+ * Every member is protected by lock.
+ */
+struct pool
+{
+    /*! @member options
+     * Options of every job.
+     */
+    struct options const* options;
+    /*! @member walk
+     * Walk yielding the files to be documented.
+     */
+    struct walk* walk;
+    /*! @member jobs
+     * Heap-allocated list of heap-allocated jobs in the order of the walk.
+     * The list grows as directories are listed.
+     */
+    struct job** jobs;
+    /*! @member job_count
+     * Number of jobs in the list.
+     */
+    size_t job_count;
+    /*! @member job_cap
+     * Capacity of the list.
+     */
+    size_t job_cap;
+    /*! @member complete
+     * True once every file of the walk has a job in the list.
+     */
+    bool complete;
+    /*! @member next
+     * Index of the next job to be started by a worker.
+     */
+    size_t next;
+    /*! @member flushed
+     * Number of jobs whose output has been written to stdout.
+     */
+    size_t flushed;
+    /*! @member window
+     * Maximum number of jobs that may be started before their output has
+     * been written, bounding the memory held in job output buffers.
+     */
+    size_t window;
+    /*! @member pages
+     * Pages claimed by the jobs in the list, checked as each job is added
+     * and before any worker starts it.
+     */
+    struct symtab* pages;
+    pthread_mutex_t lock;
+    pthread_cond_t cond;
+};
+
+/*!
+ * @function run_parallel
+ * Generate documentation for the files of walk on options->jobs worker
+ * threads.
+ * Workers list the directories of the walk as well as rendering files, so
+ * that files are documented while directories are still being listed.
+ * Each worker renders into the memory sink of its job while the calling
+ * thread writes the buffers to outs in the order of the walk.
+ * Output and error reporting are identical to processing the files one
+ * after another.
+ */
+static void
+run_parallel(
+    struct options const* options,
+    struct walk* walk,
+    struct sink* outs,
+    struct stats* totals);
+/*!
+ * @function pool_advance
+ * Append a job to pool for every file that walk_next yields.
+ * Must be called with the lock of the pool held.
+ */
+static void
+pool_advance(struct pool* pool);
+/*!
+ * @function pool_worker
+ * Thread entry point that lists directories and runs jobs of the pool
+ * passed as arg until every job has been started.
+ */
+static void*
+pool_worker(void* arg);
+#endif
+
+/*!
+ * @struct text
+ * Contents of an input file as a read-only character buffer.
+ * Regular files are memory-mapped read-only.
+ * Pipes, terminals, and other unmappable streams are read into a heap
+ * buffer instead.
+ */
+struct text
+{
+    /*! @member data
+     * Contents of the file.
+     * The buffer is not NUL-terminated.
+     */
+    char const* data;
+    /*! @member size
+     * Length of data in bytes.
+     */
+    size_t size;
+    /*! @member map_size
+     * Length of the memory mapping backing data.
+     * A value of zero implies that data is heap-allocated.
+     */
+    size_t map_size;
+};
+
+#if !defined(CDOC_NO_MAIN)
+/*!
+ * @function read_text_file
+ * Read the contents of stream into t.
+ * Encountering a NUL-byte or read failure records an error in job and
+ * returns false.
+ * @note
+ * On success the text must be released with free_text.
+ */
+static bool
+read_text_file(struct job* job, FILE* stream, struct text* t);
+/*!
+ * @function map_text_file
+ * Attempt to memory-map the regular file open on fd into t.
+ * Returns false without modifying t if the file cannot be mapped, in which
+ * case the caller should fall back to reading the stream.
+ */
+static bool
+map_text_file(int fd, struct text* t);
+/*!
+ * @function free_text
+ * Release the memory backing a text returned from read_text_file.
+ */
+static void
+free_text(struct text t);
+#endif
+
+/*!
+ * @struct file
+ * An input text together with an index of the lines within that text.
+ * Lines are identified by their 0-indexed line number and do not include
+ * the terminating newline character.
+ */
+struct file
+{
+    /*! @member text
+     * Contents of the file.
+     */
+    char const* text;
+    /*! @member lines
+     * Byte offset of the first character of each line in text.
+     * The element lines[line_count] is one past the end of the last line
+     * plus its newline, so the end of line i is always lines[i + 1] - 1.
+     */
+    uint32_t* lines;
+    /*! @member line_count
+     * Number of lines in the file.
+     */
+    uint32_t line_count;
+    /*! @member doc_lines
+     * Line index of each line beginning with a doc comment, in ascending
+     * order.
+     */
+    uint32_t* doc_lines;
+    /*! @member doc_line_count
+     * Number of lines beginning with a doc comment.
+     */
+    uint32_t doc_line_count;
+    /*! @member first_line
+     * Line index of the first line of text within the whole input.
+     * Non-zero only when text is a window into a stream, in which case it
+     * is used to report line numbers of the whole input in errors.
+     */
+    uint32_t first_line;
+    /*! @member partial
+     * True if text is a window into a stream whose later lines have not
+     * been read yet.
+     */
+    bool partial;
+};
+
+/*!
+ * @function text_to_lines
+ * Construct the line index of the provided text along with the list of
+ * lines that begin a doc comment, in a single pass over the text.
+ * The text is not modified.
+ * Text larger than 4 GiB records an error in job and returns false.
+ * @note
+ * The lines and doc_lines members of f are allocated from job->arena.
+ */
+static bool
+text_to_lines(struct job* job, struct text text, struct file* f);
+
+/*!
+ * @macro SCAN_BLOCK_SIZE
+ * Number of bytes examined by a single call to a scan_block_fn.
+ */
+#define SCAN_BLOCK_SIZE 64
+/*!
+ * @typedef scan_block_fn
+ * Compute bitmasks of the newline characters and "/\*!" sequences within
+ * the SCAN_BLOCK_SIZE bytes starting at p.
+ * Bit i of *newlines is set if p[i] is a newline and bit i of *openers is
+ * set if p[i] begins a "/\*!" sequence.
+ * @note
+ * The two bytes following the block must be readable.
+ */
+typedef void (*scan_block_fn)(
+    char const* p, uint64_t* newlines, uint64_t* openers);
+#if defined(HAVE_SSE2_SCAN) || defined(HAVE_NEON_SCAN)
+/*!
+ * @function select_scan_block
+ * Returns the fastest scan_block_fn supported by the running processor.
+ * The AVX2 implementation is chosen at runtime when available, otherwise
+ * the SSE2 or NEON implementation of the compilation target is used.
+ * Without either, text_to_lines finds each newline with memchr instead,
+ * which is faster than examining a block a character at a time.
+ */
+static scan_block_fn
+select_scan_block(void);
+#endif
+#if defined(HAVE_SSE2_SCAN)
+/*!
+ * @function scan_block_sse2
+ * SSE2 implementation of scan_block_fn.
+ */
+static void
+scan_block_sse2(char const* p, uint64_t* newlines, uint64_t* openers);
+#endif
+#if defined(HAVE_AVX2_SCAN)
+/*!
+ * @function scan_block_avx2
+ * AVX2 implementation of scan_block_fn.
+ */
+static void
+scan_block_avx2(char const* p, uint64_t* newlines, uint64_t* openers);
+#endif
+#if defined(HAVE_NEON_SCAN)
+/*!
+ * @function scan_block_neon
+ * NEON implementation of scan_block_fn.
+ */
+static void
+scan_block_neon(char const* p, uint64_t* newlines, uint64_t* openers);
+#endif
+#if defined(HAVE_SSE2_SCAN) || defined(HAVE_NEON_SCAN)
+/*!
+ * @function lowest_bit
+ * Returns the index of the least significant set bit of the non-zero
+ * value x.
+ */
+static int
+lowest_bit(uint64_t x);
+#endif
+/*!
+ * @function line_start
+ * Returns a pointer to the first character of the provided line.
+ */
+static char const*
+line_start(struct file const* f, uint32_t line);
+/*!
+ * @function line_end
+ * Returns a pointer one past the last character of the provided line.
+ */
+static char const*
+line_end(struct file const* f, uint32_t line);
+/*!
+ * @function line_of
+ * Returns the index of the line of f containing the byte at offset.
+ */
+static uint32_t
+line_of(struct file const* f, uint32_t offset);
+/*!
+ * @function is_hspace
+ * Returns true if c is a horizontal whitespace character.
+ * The characters '\t', '\r', and ' ' are considered horizontal whitespace.
+ */
+static bool
+is_hspace(int c);
+/*!
+ * @function is_doc_comment
+ * Returns true if the first non-whitespace characters of a line
+ * are "/\*!", the start of a doc-comment.
+ * @param line
+ * First character of the line.
+ * @param end
+ * One past the last character of the line.
+ */
+static bool
+is_doc_comment(char const* line, char const* end);
+/*!
+ * @function clean_doc_line
+ * Returns a pointer to the start of the actual content within a doc
+ * comment line, skipping leading whitespace and the optional '*'.
+ * The returned pointer is never past end.
+ */
+static char const*
+clean_doc_line(char const* line, char const* end);
+/*!
+ * @function find_comment_end
+ * Returns a pointer to the first "*\/" in the range [begin, end), or NULL
+ * if the range contains no end of comment.
+ */
+static char const*
+find_comment_end(char const* begin, char const* end);
+
+#if !defined(CDOC_NO_MAIN)
+/*!
+ * @function do_file
+ * Generate documentation for the provided file to job->outs.
+ * Returns false if an error was recorded in job, in which case no
+ * documentation is written for the file.
+ * With options->keep_going, docs with errors are skipped instead and
+ * false is only returned if the file could not be read.
+ * @param fp
+ * File pointer returned from fopen.
+ * The position fp's file offset should be at the beginning of the file.
+ */
+static bool
+do_file(struct job* job, FILE* fp);
+/*!
+ * @function do_text
+ * Generate documentation for the provided text to job->outs.
+ * Returns false if an error was recorded in job, in which case no
+ * documentation is written for the text.
+ */
+static bool
+do_text(struct job* job, struct text text);
+/*!
+ * @macro STREAM_CHUNK_SIZE
+ * Minimum number of bytes read from a stream by do_stream at a time.
+ */
+#define STREAM_CHUNK_SIZE (64 * 1024)
+/*!
+ * @macro STREAM_MIN_MEMORY
+ * Smallest limit accepted by --max-memory, which holds a window of a few
+ * short lines and their parse structures.
+ */
+#define STREAM_MIN_MEMORY (4 * 1024)
+/*!
+ * @function do_stream
+ * Generate documentation for the provided stream to job->outs, parsing a
+ * sliding window of complete lines as the stream is read.
+ * Each doc is written and flushed as soon as the end of its source has been
+ * read, and the text before it is discarded, so memory use is bounded by the
+ * largest doc rather than the length of the stream.
+ * A doc that reaches the end of the window is parsed again once more of the
+ * stream is available.
+ * With options->max_memory, reads are sized so that the window and the
+ * arena bytes in use stay within the limit, and a window whose structures
+ * do not fit is parsed again in fewer lines.
+ * Returns false if an error was recorded in job, in which case the docs
+ * preceding the error have already been written.
+ */
+static bool
+do_stream(struct job* job, FILE* fp);
+
+/*!
+ * @struct cache_header
+ * Header of a cache entry holding the rendered output of one input file.
+ * The header is followed by output_count 64-bit output lengths and then
+ * the bytes of each output, one for each target in options order.
+ * Entries are written in native byte order as they are only meaningful
+ * to the machine that wrote them.
+ */
+struct cache_header
+{
+    /*! @member magic
+     * Identifies the file as a cache entry: "cdoc" followed by the entry
+     * format version.
+     */
+    char magic[8];
+    /*! @member key
+     * Value of cache_key for the job that wrote this entry.
+     */
+    uint64_t key;
+    /*! @member content_hash
+     * Value of hash64 over the contents of the input file.
+     */
+    uint64_t content_hash;
+    /*! @member size
+     * Size in bytes of the input file.
+     */
+    uint64_t size;
+    /*! @member dev
+     * Device of the input file.
+     */
+    uint64_t dev;
+    /*! @member ino
+     * Inode number of the input file.
+     */
+    uint64_t ino;
+    /*! @member mtime_sec
+     * Modification time of the input file in seconds.
+     * A value of zero implies that the modification time was too recent to
+     * be trusted, so the file contents must always be hashed.
+     */
+    int64_t mtime_sec;
+    /*! @member mtime_nsec
+     * Nanoseconds component of the modification time of the input file.
+     */
+    int64_t mtime_nsec;
+    /*! @member output_count
+     * Number of outputs stored in the entry.
+     */
+    uint64_t output_count;
+};
+
+/*!
+ * @function do_cached_file
+ * Generate documentation for the provided file to job->outs, reusing the
+ * output stored in options->cache_dir when the file is unchanged.
+ * The file is not read at all if its size and modification time match
+ * the cache entry, and not parsed if its contents hash to the same value.
+ * Otherwise the file is processed by do_text and the entry is replaced.
+ * Failure to read or write the cache is not an error.
+ */
+static bool
+do_cached_file(struct job* job, FILE* fp);
+/*!
+ * @function cache_key
+ * Returns a hash identifying the cache entry of job, computed from the cdoc
+ * version, the format of each target, the filters, and the input path.
+ */
+static uint64_t
+cache_key(struct job const* job);
+/*!
+ * @function read_cache_entry
+ * Read the cache entry at path and return its output lengths and bytes as
+ * a heap-allocated list of options->target_count iovecs into *buf.
+ * Returns NULL if the entry does not exist or was not written with the
+ * provided key.
+ * On success *header holds the header of the entry and *buf must be
+ * freed along with the returned list.
+ */
+static struct iovec*
+read_cache_entry(
+    struct job const* job,
+    char const* path,
+    uint64_t key,
+    struct cache_header* header,
+    char** buf);
+/*!
+ * @function write_cache_entry
+ * Atomically replace the cache entry at path with the provided header and
+ * outputs by writing a temporary file and renaming it over path.
+ */
+static void
+write_cache_entry(
+    struct job const* job,
+    char const* path,
+    struct cache_header const* header,
+    struct iovec const* outputs);
+/*!
+ * @function set_cache_stat
+ * Record the size, identity, and modification time of st in header.
+ */
+static void
+set_cache_stat(struct cache_header* header, struct stat const* st);
+/*!
+ * @macro HASH64_PRIME1
+ * The first of the five prime constants HASH64_PRIME1 through
+ * HASH64_PRIME5 of the XXH64 algorithm.
+ */
+#define HASH64_PRIME1 UINT64_C(0x9E3779B185EBCA87)
+#define HASH64_PRIME2 UINT64_C(0xC2B2AE3D27D4EB4F)
+#define HASH64_PRIME3 UINT64_C(0x165667B19E3779F9)
+#define HASH64_PRIME4 UINT64_C(0x85EBCA77C2B2AE63)
+#define HASH64_PRIME5 UINT64_C(0x27D4EB2F165667C5)
+/*!
+ * @macro ROTL64
+ * Rotate the 64-bit value x left by r bits, where 0 < r < 64.
+ */
+#define ROTL64(/* uint64_t */ x, /* int */ r)                                 \
+    (((x) << (r)) | ((x) >> (64 - (r))))
+/*!
+ * @function hash64
+ * Returns the XXH64 hash of size bytes of data with the provided seed.
+ */
+static uint64_t
+hash64(void const* data, size_t size, uint64_t seed);
+/*!
+ * @function hash64_round
+ * Mix 8 bytes of input into an XXH64 accumulator.
+ */
+static uint64_t
+hash64_round(uint64_t acc, uint64_t input);
+/*!
+ * @function read_u64
+ * Returns the unaligned 64-bit value at p in native byte order.
+ */
+static uint64_t
+read_u64(unsigned char const* p);
+
+/*!
+ * @macro WATCH_POLL_INTERVAL
+ * Seconds between scans of the watched directory when change
+ * notifications are not available.
+ */
+#define WATCH_POLL_INTERVAL 1
+/*!
+ * @macro WATCH_SETTLE_MS
+ * Milliseconds without change notifications to wait for before scanning
+ * the watched directory, so that a burst of writes results in a single
+ * rebuild.
+ */
+#define WATCH_SETTLE_MS 50
+
+/*!
+ * @struct watch_file
+ * An input file of the watched directory along with its documentation as
+ * of the last time it was processed.
+ */
+struct watch_file
+{
+    /*! @member path
+     * Heap-allocated path of the file, prefixed with the watched directory.
+     */
+    char* path;
+    /*! @member st
+     * Status of the file when it was last scanned.
+     */
+    struct stat st;
+    /*! @member recent
+     * True if the file was modified too recently for its modification time
+     * to be trusted, so it must be processed again on the next scan.
+     */
+    bool recent;
+    /*! @member outputs
+     * Heap-allocated memory sinks holding the documentation of the file,
+     * one for each element of options->targets, or NULL if the file has
+     * not been processed since it last changed.
+     */
+    struct sink* outputs;
+};
+
+/*!
+ * @function run_watch
+ * Generate documentation for the C source and header files of
+ * options->watch_dir, then regenerate it whenever a file is added,
+ * modified, or removed, until the process is terminated.
+ * Only the changed files are processed again, as the output of every other
+ * file is kept in memory.
+ * Each target is atomically replaced with the output of every file in path
+ * order, so a reader never observes a partially written target.
+ * Changes are detected with inotify where available, and otherwise by
+ * scanning the directory every WATCH_POLL_INTERVAL seconds.
+ */
+static void
+run_watch(struct options const* options);
+/*!
+ * @function scan_watch_dir
+ * Replace the list of *count files at *files with the C source and header
+ * files currently in options->watch_dir, sorted by path.
+ * A file whose size, identity, and modification time are unchanged keeps
+ * its outputs from the previous list.
+ * Returns true if any file was added, modified, or removed.
+ */
+static bool
+scan_watch_dir(
+    struct options const* options, struct watch_file** files, size_t* count);
+/*!
+ * @function is_watched_name
+ * Returns true if the directory entry name is a C source or header file
+ * that is not hidden.
+ */
+static bool
+is_watched_name(char const* name);
+/*!
+ * @function compare_watch_files
+ * Comparison function passed to qsort ordering watch files by path.
+ */
+static int
+compare_watch_files(void const* lhs, void const* rhs);
+/*!
+ * @function render_watch_file
+ * Process file into newly allocated file->outputs, reporting any errors
+ * without exiting.
+ * The stats of the file are added to totals.
+ */
+static void
+render_watch_file(
+    struct options const* options,
+    struct watch_file* file,
+    struct arena* arena,
+    struct stats* totals);
+/*!
+ * @function replace_file
+ * Atomically replace the file at path with the concatenation of count
+ * parts by writing a temporary file with permissions mode and renaming it
+ * over path.
+ * Returns zero, or the errno value of the first operation that failed, in
+ * which case path is left untouched.
+ */
+static int
+replace_file(
+    char const* path, struct iovec const* parts, size_t count, mode_t mode);
+/*!
+ * @function wait_for_change
+ * Block until the watched directory may have changed.
+ * @param fd
+ * Inotify file descriptor watching the directory, or -1 to sleep for
+ * WATCH_POLL_INTERVAL seconds.
+ */
+static void
+wait_for_change(int fd);
+#endif
+
+/*!
+ * @struct doc
+ * Representation of a document, aka a list of doc-sections documenting the
+ * a single portion of a C source file.
+ *
+ * The cdoc documentation:
+ * <pre><code>
+ * /\*!
+ * * @struct foo
+ * * The struct used for fooing.
+ * * @note
+ * * Be careful not to bar this foo.
+ * *\/
+ * struct foo
+ * {
+ * int some_member;
+ * };
+ * </code></pre>
+ * is comprised of two sections (beginning with @struct and @note) and
+ * four lines of source.
+ */
+struct doc
+{
+    /*! @member sections
+     * Arena-allocated list of sections in this doc.
+     */
+    struct section* sections;
+    /*! @member section_count
+     * Number of sections in this doc.
+     */
+    size_t section_count;
+    /*! @member has_source
+     * True if this doc has associated source code.
+     */
+    bool has_source;
+    /*! @member skipped
+     * True if the doc is left out by the filters of options, in which case
+     * its source is only parsed to find where the doc ends and the doc is
+     * not rendered.
+     */
+    bool skipped;
+    /*! @member source_elided
+     * True if the source ends in a function body that was not captured.
+     */
+    bool source_elided;
+    /*! @member source_start
+     * Line index of the first line of source code associated with this doc.
+     */
+    uint32_t source_start;
+    /*! @member source_len
+     * Number of lines of source code associated with this doc.
+     */
+    uint32_t source_len;
+};
+/*!
+ * @struct section
+ * Representation of a portion of a document, specifically one facet of the
+ * subject of the doc.
+ * Each section has a mandatory tag, an optional name, and optional body
+ * of description text.
+ * The doc-lines:
+ * <pre><code>
+ * /\*!
+ * * @struct foo
+ * * The struct used for fooing.
+ * *\/
+ * </code></pre>
+ * form one section with the tag "struct", the name "foo" and a text body
+ * containing the single line of text "The struct used for fooing.".
+ */
+struct section
+{
+    /*! @member tag_start
+     * Byte offset of the first character in the tag slice.
+     */
+    uint32_t tag_start;
+    /*! @member tag_len
+     * Length of the tag slice.
+     */
+    uint32_t tag_len;
+    /*! @member tag
+     * Identifier of the tag, or TAG_UNKNOWN if the tag is not one cdoc
+     * knows.
+     */
+    enum tag tag;
+
+    /*! @member name_start
+     * Byte offset of the first character in the name slice.
+     */
+    uint32_t name_start;
+    /*! @member name_len
+     * Length of the name slice.
+     * A length of zero implies that this tag has no name.
+     */
+    uint32_t name_len;
+
+    /*! @member text_start
+     * Line index of the first line in the text body.
+     */
+    uint32_t text_start;
+    /*! @member text_len
+     * Length of the text body in lines.
+     * A length of zero implies that this tag has no body.
+     */
+    uint32_t text_len;
+    /*! @member text_end
+     * Byte offset at which the text body ends, i.e. the location of the
+     * end of the doc comment.
+     * Text lines are truncated at this offset.
+     */
+    uint32_t text_end;
+};
+
+/*!
+ * @struct output
+ * A renderer paired with the sink it writes to, along with the state of a
+ * single rendering pass over one file.
+ */
+struct output
+{
+    /*! @member renderer
+     * Format in which documentation is written.
+     */
+    struct renderer const* renderer;
+    /*! @member sink
+     * Destination of the rendered documentation.
+     */
+    struct sink* sink;
+    /*! @member first
+     * True if nothing has been written to the innermost open list of a
+     * renderer that separates list elements, i.e. JSON.
+     */
+    bool first;
+    /*! @member doc_ordinal
+     * Value of count_doc for the doc being rendered, set by the caller of
+     * print_doc.
+     * The anchors of every doc but the first of a name are told apart by
+     * the suffix written by write_doc_suffix.
+     */
+    uint32_t doc_ordinal;
+    /*! @member doc_name
+     * Name of the first section of the doc being rendered, from which the
+     * anchors of its other sections are derived.
+     */
+    char const* doc_name;
+    /*! @member doc_name_len
+     * Length of doc_name.
+     * A length of zero implies that the doc has no name.
+     */
+    size_t doc_name_len;
+    /*! @member section_index
+     * Index of the section being rendered within its doc.
+     */
+    size_t section_index;
+    /*! @member section_tag
+     * Identifier of the tag of the section being rendered.
+     */
+    enum tag section_tag;
+    /*! @member source_state
+     * The lex_state between two source lines of the doc being highlighted.
+     */
+    unsigned char source_state;
+    /*! @member source_bol
+     * True if the next source line of the doc being highlighted begins a
+     * logical line, and so may begin a preprocessing directive.
+     */
+    bool source_bol;
+};
+
+/*!
+ * @struct renderer
+ * Table of functions producing one output format.
+ * A file is rendered as begin_file, then for each doc begin_doc, each
+ * section (section_header, every text_line, end_section), the source
+ * (begin_source, every source_line, end_source) if the doc has any, and
+ * end_doc, then finally end_file.
+ * Every function other than section_header, text_line, and source_line may
+ * be NULL, and every function other than render_file is ignored when
+ * render_file is set.
+ */
+struct renderer
+{
+    /*! @member name
+     * Name of the format as given to the --format option.
+     */
+    char const* name;
+    /*! @member begin_file
+     * Called before the docs of the file at path are rendered.
+     */
+    void (*begin_file)(struct output* o, char const* path);
+    /*! @member end_file
+     * Called after every doc of the file has been rendered.
+     */
+    void (*end_file)(struct output* o);
+    /*! @member begin_doc
+     * Called before the sections of doc d are rendered.
+     */
+    void (*begin_doc)(struct output* o, struct doc const* d);
+    /*! @member end_doc
+     * Called after the sections and source of doc d have been rendered.
+     */
+    void (*end_doc)(struct output* o, struct doc const* d);
+    /*! @member section_header
+     * Write the tag and name of a section.
+     * A name_len of zero implies that the section has no name.
+     */
+    void (*section_header)(
+        struct output* o,
+        char const* tag,
+        size_t tag_len,
+        char const* name,
+        size_t name_len);
+    /*! @member text_line
+     * Write one line of the text body of the current section.
+     */
+    void (*text_line)(struct output* o, char const* text, size_t len);
+    /*! @member end_section
+     * Called after the text body of the current section.
+     */
+    void (*end_section)(struct output* o);
+    /*! @member begin_source
+     * Called before the source code of the current doc is rendered.
+     */
+    void (*begin_source)(struct output* o);
+    /*! @member source_line
+     * Write one line of the source code of the current doc.
+     */
+    void (*source_line)(struct output* o, char const* line, size_t len);
+    /*! @member end_source
+     * Called after the source code of the current doc.
+     * @param elided
+     * True if the source ends in a function body that was not captured.
+     */
+    void (*end_source)(struct output* o, bool elided);
+    /*! @member print_doc
+     * Renders doc d of file f through the other functions of the renderer,
+     * or NULL for print_doc to call them through the table.
+     * Defined by DEFINE_PRINT_DOC, which calls them directly.
+     */
+    void (*print_doc)(
+        struct output* o, struct file const* f, struct doc const* d);
+    /*! @member render_file
+     * Called in place of every other function to render the count docs of
+     * the file f at path at once, or NULL.
+     * Used by formats that are not a sequence of rendered docs, i.e. the IR.
+     */
+    void (*render_file)(
+        struct output* o,
+        char const* path,
+        struct file const* f,
+        struct doc const* docs,
+        size_t count);
+};
+
+/*!
+ * @enum lex_state
+ * State of the C lexer between two characters of source.
+ */
+enum lex_state
+{
+    LEX_CODE,
+    LEX_SLASH, // Code following a '/' that may begin a comment.
+    LEX_CODE_ESCAPE, // Code following a '\' that may splice lines.
+    LEX_LINE_COMMENT,
+    LEX_LINE_COMMENT_ESCAPE,
+    LEX_BLOCK_COMMENT,
+    LEX_BLOCK_STAR, // Block comment following a '*' that may end it.
+    LEX_STRING,
+    LEX_STRING_ESCAPE,
+    LEX_CHAR,
+    LEX_CHAR_ESCAPE,
+    LEX_STATE_COUNT
+};
+
+/*!
+ * @enum lex_class
+ * Class of a source character, the column of the lexer transition table.
+ * Every character not listed is LEX_OTHER.
+ */
+enum lex_class
+{
+    LEX_OTHER,
+    LEX_C_SLASH,
+    LEX_C_STAR,
+    LEX_C_BACKSLASH,
+    LEX_C_DQUOTE,
+    LEX_C_SQUOTE,
+    LEX_C_LBRACE,
+    LEX_C_RBRACE,
+    LEX_C_SEMICOLON,
+    LEX_C_NEWLINE,
+    LEX_CLASS_COUNT
+};
+
+/*!
+ * @enum lex_token
+ * Token of interest to the source parsers produced by a lexer transition.
+ */
+enum lex_token
+{
+    LEX_NONE, // No token, or the end of the line when returned by lex_next.
+    LEX_LBRACE,
+    LEX_RBRACE,
+    LEX_SEMICOLON,
+    LEX_EOL, // End of a logical line, i.e. not spliced or in a comment.
+};
+
+/*!
+ * @struct lex_transition
+ * An entry of the lexer transition table.
+ */
+struct lex_transition
+{
+    /*! @member state
+     * The lex_state following the character.
+     */
+    unsigned char state;
+    /*! @member token
+     * The lex_token produced by the character.
+     */
+    unsigned char token;
+};
+
+/*!
+ * @struct lexer
+ * Single-pass C lexer recognizing the braces, semicolons, and ends of
+ * lines that are outside of comments, string literals, and character
+ * constants.
+ * Each character costs one class lookup and one transition lookup, and is
+ * examined exactly once.
+ */
+struct lexer
+{
+    /*! @member state
+     * The lex_state before the character at cp.
+     */
+    unsigned char state;
+    /*! @member cp
+     * Next character of the current line to be lexed.
+     */
+    char const* cp;
+    /*! @member end
+     * End of the current line, excluding its newline.
+     */
+    char const* end;
+    /*! @member eol
+     * True once the newline of the current line has been lexed.
+     */
+    bool eol;
+};
+
+/*!
+ * @function lex_line
+ * Continue lexing with the line [start, end) followed by a newline.
+ */
+static void
+lex_line(struct lexer* lx, char const* start, char const* end);
+/*!
+ * @function lex_next
+ * Returns the next token of the current line, or LEX_NONE once the line
+ * and its newline have been lexed.
+ */
+static enum lex_token
+lex_next(struct lexer* lx);
+/*!
+ * @function lex_skip_code
+ * Returns the first character in [cp, end) that may change the state of
+ * the lexer or produce a token in the LEX_CODE state, or end.
+ * Sixteen characters are examined at a time when SSE2 or NEON is
+ * available.
+ */
+static char const*
+lex_skip_code(char const* cp, char const* end);
+/*!
+ * @function lex_skip_plain
+ * Returns the first character in [cp, end) that may start a comment, string
+ * literal, or character constant in the LEX_CODE state, or end.
+ * Sixteen characters are examined at a time when SSE2 or NEON is
+ * available.
+ */
+static char const*
+lex_skip_plain(char const* cp, char const* end);
+
+/*!
+ * @function parse_struct_source
+ * Parse the lines of a struct forward declaration or definition using the
+ * provided parse state.
+ * @note
+ * The method used for parsing in this function happens to work for
+ * struct, union, enum, typedef, and variable declarations.
+ */
+static void
+parse_struct_source(struct file const* f, uint32_t* linep, struct doc* d);
+/*!
+ * @function parse_function_source
+ * Parse the lines of a function prototype or definition using the provided
+ * parse state.
+ */
+static void
+parse_function_source(struct file const* f, uint32_t* linep, struct doc* d);
+/*!
+ * @function parse_macro_source
+ * Parse the lines of a preprocessor macro using the provided parse state.
+ */
+static void
+parse_macro_source(struct file const* f, uint32_t* linep, struct doc* d);
+/*!
+ * @function source_limit
+ * Returns the line at which parsing the source of d may stop: the end of
+ * f, or for a skipped doc of a whole text, the line following the last doc
+ * comment of f.
+ * The source of a skipped doc is only parsed to find the doc comments it
+ * hides, of which there are none past that line.
+ */
+static uint32_t
+source_limit(struct file const* f, struct doc const* d);
+/*!
+ * @function parse_doc
+ * Construct a doc from the provided parse state parameters.
+ * Returns false if an error was recorded in job, in which case *linep is
+ * the line following the doc comment so that parsing may resume there.
+ */
+static bool
+parse_doc(
+    struct job* job, struct file const* f, uint32_t* linep, struct doc* d);
+#if !defined(CDOC_NO_MAIN)
+/*!
+ * @function parse_window
+ * Parse the first size bytes of the window of do_stream at buf, whose first
+ * line is line first_line of the stream, and which is made of complete
+ * lines followed by more text if partial is true.
+ * The line index and the docs are allocated from job->arena, the complete
+ * docs are stored in *docs and *doc_count, the first line of the doc
+ * reaching the end of a partial window, or the line count, in *keep, and
+ * the line following the first complete doc, or zero, in *first_end.
+ * The time spent splitting lines is added to the stats of job from *start.
+ * Returns false if parsing must stop, with the error recorded in job.
+ */
+static bool
+parse_window(
+    struct job* job,
+    char const* buf,
+    size_t size,
+    bool partial,
+    uint32_t first_line,
+    double* start,
+    struct file* f,
+    struct doc** docs,
+    size_t* doc_count,
+    uint32_t* keep,
+    uint32_t* first_end);
+#endif
+/*!
+ * @function parse_text
+ * Index the lines of text into *f and parse its docs into a list at *docs,
+ * leaving out the docs skipped by the filters of job->options.
+ * Returns false if an error was recorded in job, in which case the docs
+ * must not be rendered.
+ * With options->keep_going, docs with errors are left out instead.
+ * @note
+ * The line index and the docs are allocated from job->arena.
+ */
+static bool
+parse_text(
+    struct job* job,
+    struct text text,
+    struct file* f,
+    struct doc** docs,
+    size_t* doc_count);
+
+/*!
+ * @struct cdoc_ctx
+ * Parser context of libcdoc, holding a job with no targets whose arena is
+ * reset, but not released, after each call to cdoc_parse.
+ */
+struct cdoc_ctx
+{
+    /*! @member options
+     * Filters and keep_going of the context.
+     */
+    struct options options;
+    /*! @member job
+     * Job parsing the buffer of the current call, and holding the errors of
+     * the last call.
+     */
+    struct job job;
+    /*! @member arena
+     * Arena of job, holding the parse structures of the current call.
+     */
+    struct arena arena;
+    /*! @member values
+     * Heap-allocated list of heap-allocated copies of the filter values,
+     * which the patterns of options point into.
+     */
+    char** values;
+    /*! @member value_count
+     * Number of values in the list.
+     */
+    size_t value_count;
+};
+
+/*!
+ * @function export_doc
+ * Fill *out with the sections and source of d for a cdoc_doc_fn.
+ * The lines of out are allocated from arena.
+ */
+static void
+export_doc(
+    struct arena* arena,
+    struct file const* f,
+    struct doc const* d,
+    struct cdoc_doc* out);
+/*!
+ * @function clear_errors
+ * Release the errors recorded in job.
+ */
+static void
+clear_errors(struct job* job);
+
+/*!
+ * @function doc_is_selected
+ * Returns true if the doc d passes the tag and name filters of
+ * job->options.
+ * Only the sections of d are examined, so this may be called before its
+ * source is parsed.
+ */
+static bool
+doc_is_selected(struct job* job, struct file const* f, struct doc const* d);
+/*!
+ * @function match_tag
+ * Returns true if the tag of section s is one of count patterns.
+ */
+static bool
+match_tag(
+    struct tag_pattern const* patterns,
+    size_t count,
+    struct file const* f,
+    struct section const* s);
+/*!
+ * @function match_name
+ * Returns true if the NUL-terminated name matches one of count globs.
+ */
+static bool
+match_name(char const* const* patterns, size_t count, char const* name);
+#if !defined(CDOC_NO_MAIN)
+/*!
+ * @function print_doc
+ * Render this doc to the provided output.
+ */
+static void
+print_doc(struct output* o, struct file const* f, struct doc const* d);
+/*!
+ * @function print_doc_with
+ * Render this doc to the provided output through the functions of r.
+ * Always inlined, so that a constant r calls every function directly and
+ * lets the compiler inline them as well.
+ */
+static ALWAYS_INLINE void
+print_doc_with(
+    struct output* o,
+    struct file const* f,
+    struct doc const* d,
+    struct renderer const* r);
+/*!
+ * @function count_doc
+ * Count d among the docs of its file in names, and return the number of
+ * docs counted with the name of d, or zero if d has no name.
+ * The first field of the slot of each name holds its count.
+ */
+static uint32_t
+count_doc(struct symtab* names, struct file const* f, struct doc const* d);
+/*!
+ * @function write_doc_suffix
+ * Write the suffix of the anchors of the doc being rendered to s: "-2" for
+ * the second doc of its name in the file and so on, and nothing for the
+ * first.
+ */
+static void
+write_doc_suffix(struct sink* s, struct output const* o);
+/*!
+ * @macro DEFINE_PRINT_DOC
+ * Declare the renderer FORMAT_renderer, and define FORMAT_print_doc, its
+ * print_doc, from the print_doc_with template.
+ */
+#define DEFINE_PRINT_DOC(format)                                               \
+    static struct renderer const format##_renderer;                         \
+    static void format##_print_doc(                                            \
+        struct output* o, struct file const* f, struct doc const* d)           \
+    {                                                                          \
+        print_doc_with(o, f, d, &format##_renderer);                           \
+    }
+#endif
+/*!
+ * @function parse_section
+ * Construct a section from the provided parse state parameters.
+ * Returns false if an error was recorded in job.
+ * @param line
+ * First character of the tag line, i.e. the '@'.
+ * @param end
+ * One past the last character of the tag line.
+ * @param linep
+ * Line index of the tag line.
+ * On return, the line index of the first line following the text body.
+ * @param last_line
+ * Line index of the last line in the doc comment.
+ * @param comment_end
+ * Byte offset of the end of the doc comment.
+ */
+static bool
+parse_section(
+    struct job* job,
+    struct file const* f,
+    char const* line,
+    char const* end,
+    uint32_t* linep,
+    uint32_t last_line,
+    uint32_t comment_end,
+    struct section* s);
+#if !defined(CDOC_NO_MAIN)
+/*!
+ * @function print_section
+ * Render this section to the provided output through the functions of r.
+ * Always inlined into print_doc_with.
+ */
+static ALWAYS_INLINE void
+print_section(
+    struct output* o,
+    struct file const* f,
+    struct section const* s,
+    struct renderer const* r);
+
+/*!
+ * @function find_renderer
+ * Returns the renderer of the format with the provided name, or NULL if no
+ * such format exists.
+ */
+static struct renderer const*
+find_renderer(char const* name);
+/*!
+ * @function json_write_string
+ * Write size bytes of text to s as a quoted JSON string.
+ * Runs of characters that need no escaping are copied at once.
+ */
+static void
+json_write_string(struct sink* s, char const* text, size_t size);
+/*!
+ * @function man_write_text
+ * Write size bytes of text to s, escaping backslashes for roff(7).
+ * Runs of characters that need no escaping are copied at once.
+ */
+static void
+man_write_text(struct sink* s, char const* text, size_t size);
+/*!
+ * @function man_write_line
+ * Write a line of text to s as roff(7) text, guarding a leading control
+ * character so that the line is not interpreted as a request.
+ */
+static void
+man_write_line(struct sink* s, char const* text, size_t size);
+/*!
+ * @function html_write_anchor
+ * Write size bytes of name to s as part of an HTML id or fragment,
+ * replacing every character other than letters, digits, '_', '-', and '.'
+ * with '_'.
+ */
+static void
+html_write_anchor(struct sink* s, char const* name, size_t size);
+/*!
+ * @function html_write_text
+ * Write size bytes of text to s as HTML text, replacing '&', '<', and '>'
+ * with character references.
+ * Runs of characters that need no escaping are copied at once.
+ */
+static void
+html_write_text(struct sink* s, char const* text, size_t size);
+/*!
+ * @function html_write_line
+ * Write a line of text to s as HTML text followed by a newline character.
+ */
+static void
+html_write_line(struct sink* s, char const* text, size_t size);
+/*!
+ * @function html_skip_text
+ * Returns the first '&', '<', or '>' in [cp, end), or end.
+ * Sixteen characters are examined at a time when SSE2 or NEON is
+ * available.
+ */
+static char const*
+html_skip_text(char const* cp, char const* end);
+#if defined(HAVE_SSE2_SCAN)
+/*!
+ * @function html_special_mask
+ * Returns a vector whose bytes are all ones where a holds '&', '<', or
+ * '>', and zero elsewhere.
+ */
+static __m128i
+html_special_mask(__m128i a);
+#endif
+/*!
+ * @variable html_highlight_renderer
+ * Renderer used in place of the html renderer with --highlight.
+ * It is named html as well, so that its pages are named and linked to like
+ * those of the html renderer.
+ * Highlighted tokens are wrapped in a span of class kw (keyword), num
+ * (number), str (string or character literal, or header name), com
+ * (comment), or pp (preprocessing directive).
+ */
+static struct renderer const html_highlight_renderer;
+/*!
+ * @variable symbol_renderer
+ * Renderer of the hidden target that collects the symbols of each file for
+ * options->index_path.
+ * Its output is a sequence of records, each a kind character followed by
+ * NUL-terminated fields: 'F' and the path of a file, 'D' and the tag and
+ * name of the first section of a doc other than @see followed by the
+ * suffix of its anchors from write_doc_suffix, or 'R' and the name of a
+ * @see section.
+ * Being a target, the records are cached, buffered by concurrent jobs,
+ * and ordered like any other output.
+ */
+static struct renderer const symbol_renderer;
+
+/*!
+ * @macro SYMBOL_NONE
+ * Index used in place of a symbol where there is none.
+ */
+#define SYMBOL_NONE UINT32_MAX
+
+/*!
+ * @struct symbol
+ * A doc defining a name, as recorded in a symbol table.
+ */
+struct symbol
+{
+    /*! @member name
+     * Offset of the interned name of the symbol in the string pool.
+     */
+    uint32_t name;
+    /*! @member tag
+     * Offset of the interned tag of the first section of the doc.
+     */
+    uint32_t tag;
+    /*! @member path
+     * Offset of the interned path of the file containing the doc.
+     */
+    uint32_t path;
+    /*! @member suffix
+     * Offset of the interned suffix of the anchors of the doc, which tells
+     * it apart from the earlier docs of its name in the file.
+     */
+    uint32_t suffix;
+    /*! @member next
+     * Index of the next symbol with the same name in argument order, or
+     * SYMBOL_NONE.
+     */
+    uint32_t next;
+};
+
+/*!
+ * @struct symtab_slot
+ * A slot of the open-addressing hash table of a symtab, holding one
+ * interned string.
+ */
+struct symtab_slot
+{
+    /*! @member hash
+     * Value of hash64 over the string.
+     */
+    uint64_t hash;
+    /*! @member offset
+     * Offset of the string in the string pool plus one.
+     * A value of zero implies that the slot is empty.
+     */
+    uint32_t offset;
+    /*! @member first
+     * Index of the first symbol with this name, or SYMBOL_NONE.
+     */
+    uint32_t first;
+    /*! @member last
+     * Index of the last symbol with this name, or SYMBOL_NONE.
+     */
+    uint32_t last;
+};
+
+/*!
+ * @struct symtab
+ * Table of the symbols defined by every input file.
+ * Names, tags, and paths are interned into a single string pool through a
+ * flat hash table with linear probing, so that looking up a name costs one
+ * hash and, typically, one string comparison.
+ */
+struct symtab
+{
+    /*! @member pool
+     * Heap-allocated NUL-terminated strings, each stored once.
+     */
+    char* pool;
+    /*! @member pool_size
+     * Number of bytes used in pool.
+     */
+    size_t pool_size;
+    /*! @member pool_cap
+     * Capacity of pool in bytes.
+     */
+    size_t pool_cap;
+    /*! @member slots
+     * Heap-allocated hash table of interned strings.
+     */
+    struct symtab_slot* slots;
+    /*! @member slot_count
+     * Number of slots in the table, always zero or a power of two.
+     */
+    size_t slot_count;
+    /*! @member used
+     * Number of non-empty slots, kept below three quarters of slot_count.
+     */
+    size_t used;
+    /*! @member symbols
+     * Heap-allocated list of symbols in argument order.
+     */
+    struct symbol* symbols;
+    /*! @member symbol_count
+     * Number of symbols in the list.
+     */
+    size_t symbol_count;
+    /*! @member symbol_cap
+     * Capacity of the list.
+     */
+    size_t symbol_cap;
+};
+
+/*!
+ * @function symtab_intern
+ * Returns the slot of the string of len bytes at str, adding the string
+ * to the pool if it is not already present.
+ * @note
+ * The returned slot is only valid until the next call to symtab_intern.
+ */
+static struct symtab_slot*
+symtab_intern(struct symtab* t, char const* str, size_t len);
+/*!
+ * @function symtab_reserve
+ * Grow the hash table of t, if needed, so that count strings can be
+ * interned without growing it again.
+ */
+static void
+symtab_reserve(struct symtab* t, size_t count);
+/*!
+ * @function symtab_probe
+ * Returns the slot holding the string of len bytes at str, or the empty
+ * slot at which it would be inserted.
+ * The table must have at least one empty slot.
+ */
+static struct symtab_slot*
+symtab_probe(
+    struct symtab const* t, char const* str, size_t len, uint64_t hash);
+/*!
+ * @function symtab_add
+ * Append a symbol with the provided name, interned tag, interned path, and
+ * interned anchor suffix to the list of symbols of t.
+ */
+static void
+symtab_add(
+    struct symtab* t,
+    char const* name,
+    size_t name_len,
+    uint32_t tag,
+    uint32_t path,
+    uint32_t suffix);
+/*!
+ * @function symtab_find
+ * Returns the index of the first symbol with the provided name, or
+ * SYMBOL_NONE if no doc defines the name.
+ */
+static uint32_t
+symtab_find(struct symtab const* t, char const* name, size_t len);
+/*!
+ * @function symtab_free
+ * Release the memory held by t.
+ */
+static void
+symtab_free(struct symtab* t);
+/*!
+ * @function claim_page
+ * Record in pages the path of each page that job writes below
+ * options->output_dir, as a symbol named by the page whose path is the
+ * path of the job.
+ * A page already claimed by an earlier job records an error in job and
+ * returns false, so that the job is not run and the page of the earlier
+ * file is kept.
+ */
+static bool
+claim_page(struct symtab* pages, struct job* job);
+/*!
+ * @function render_index
+ * Write an HTML index of the symbols recorded by symbol_renderer in the
+ * size bytes at data to out, sorted by name.
+ * Each entry links to the anchor of its doc in the first HTML target.
+ * Every @see reference to a name that no doc defines is reported to
+ * stderr as a warning, as is, with a page per file, every reference to a
+ * name that only the docs of other files define, since its link only
+ * reaches the anchors of its own page.
+ */
+static void
+render_index(
+    struct options const* options,
+    char const* data,
+    size_t size,
+    struct sink* out);
+/*!
+ * @function relative_path
+ * Returns a heap-allocated path to the file to, relative to the directory
+ * containing the file from.
+ * Both paths are canonicalized first, and are made absolute against the
+ * current directory if either is absolute or from leaves it through "..".
+ * A canonical copy of to is returned if the current directory is unknown.
+ */
+static char*
+relative_path(char const* from, char const* to);
+/*!
+ * @function canonical_path
+ * Returns a heap-allocated copy of path without empty or "." components,
+ * and without ".." components following a directory name.
+ * A relative path is made absolute against cwd if cwd is not NULL.
+ */
+static char*
+canonical_path(char const* path, char const* cwd);
+/*!
+ * @function page_href
+ * Returns a heap-allocated link from the file at from to the page of the
+ * first HTML target written to a file that documents the input file at
+ * path, or NULL if there is no such target.
+ */
+static char*
+page_href(struct options const* options, char const* from, char const* path);
+
+/*!
+ * @macro SEARCH_MAGIC
+ * First bytes of a search index: "cdocsx" followed by the format version.
+ */
+#define SEARCH_MAGIC "cdocsx1"
+/*!
+ * @macro SEARCH_TOKEN_MAX
+ * Length of the longest token recorded in a search index.
+ */
+#define SEARCH_TOKEN_MAX 64
+/*!
+ * @variable search_renderer
+ * Renderer of the hidden target that collects the tokens of each file for
+ * options->search_index.
+ * Its output is a sequence of records like that of symbol_renderer: 'F'
+ * and the path of a file, 'D' and the tag and name of the first section
+ * of a doc and the suffix of its anchors, or 'T' and a token of the tag,
+ * name, or text of a section of the last doc.
+ * A token is a lowercase run of letters, digits, and '_' of at least two
+ * and at most SEARCH_TOKEN_MAX characters, each part of a run split at
+ * '_' being a token as well.
+ */
+static struct renderer const search_renderer;
+/*!
+ * @struct search_posting
+ * Occurrence of a token in a doc, as collected by render_search_index.
+ */
+struct search_posting
+{
+    /*! @member token
+     * Index of the token in the order in which tokens were first seen.
+     */
+    uint32_t token;
+    /*! @member doc
+     * Index of the doc in argument order.
+     */
+    uint32_t doc;
+};
+/*!
+ * @function render_search_index
+ * Write the search index of the records of search_renderer in the size
+ * bytes at data to out.
+ * The index maps each token to the ascending list of docs containing it,
+ * stored as the differences between consecutive docs in varints, so that
+ * a static page can load it and answer queries without the HTML.
+ */
+static void
+render_search_index(
+    struct options const* options,
+    char const* data,
+    size_t size,
+    struct sink* out);
+
+/*!
+ * @macro IR_MAGIC
+ * First bytes of an IR file: "cdocir" followed by the format version.
+ */
+#define IR_MAGIC "cdocir2"
+/*!
+ * @macro IR_ALIGN
+ * Alignment of each chunk of an IR file, and of its size.
+ */
+#define IR_ALIGN 8
+/*!
+ * @struct ir_header
+ * Header of an IR file, holding the parsed docs of a run of cdoc so that
+ * they can be rendered again without the input files.
+ * The header is followed by file_count 64-bit offsets from the start of the
+ * IR file, one for the ir_chunk of each input file in argument order, and
+ * then by the file_count 64-bit positions of the files in the walk of
+ * every shard, by which the files of the shards of a run are merged.
+ * Like cache entries, IR files are written in native byte order and layout,
+ * so that they can be mapped and used in place by the machine that wrote
+ * them.
+ */
+struct ir_header
+{
+    /*! @member magic
+     * IR_MAGIC, NUL-terminated.
+     */
+    char magic[8];
+    /*! @member section_size
+     * Size of struct section, which is stored in the IR as it is in memory.
+     */
+    uint32_t section_size;
+    /*! @member doc_size
+     * Size of struct ir_doc.
+     */
+    uint32_t doc_size;
+    /*! @member shard
+     * Index of the shard of the run that wrote the file, if shard_count is
+     * set.
+     */
+    uint32_t shard;
+    /*! @member shard_count
+     * Number of shards of the run that wrote the file, or zero if the run
+     * was not sharded.
+     */
+    uint32_t shard_count;
+    /*! @member file_count
+     * Number of input files.
+     */
+    uint64_t file_count;
+};
+
+/*!
+ * @struct ir_file
+ * Input file of one of the IR files rendered by run_ir.
+ */
+struct ir_file
+{
+    /*! @member position
+     * Position of the file in the walk of every shard.
+     */
+    uint64_t position;
+    /*! @member ir
+     * Index of the IR file in options->from_ir.
+     */
+    size_t ir;
+    /*! @member chunk
+     * The ir_chunk of the file.
+     */
+    char const* chunk;
+};
+
+/*!
+ * @struct ir_chunk
+ * Parsed docs of one input file within an IR file.
+ * The chunk holds the line offsets, the ir_doc records, the sections, and
+ * a string table holding the path and the text of the lines used by the
+ * docs, in that order.
+ * Offsets are relative to the start of the chunk, so a chunk can be
+ * produced by a job on its own, cached, and copied into any IR file.
+ * The sections use the byte offsets and line indices of the text of the
+ * chunk rather than those of the input file.
+ */
+struct ir_chunk
+{
+    /*! @member size
+     * Size of the chunk in bytes, a multiple of IR_ALIGN.
+     */
+    uint32_t size;
+    /*! @member path
+     * Offset of the NUL-terminated path of the input file.
+     */
+    uint32_t path;
+    /*! @member text
+     * Offset of the text.
+     */
+    uint32_t text;
+    /*! @member text_size
+     * Size of the text in bytes.
+     */
+    uint32_t text_size;
+    /*! @member lines
+     * Offset of the line_count + 1 line offsets of the text, as in the
+     * lines member of struct file.
+     */
+    uint32_t lines;
+    /*! @member line_count
+     * Number of lines of the text.
+     */
+    uint32_t line_count;
+    /*! @member docs
+     * Offset of the ir_doc records.
+     */
+    uint32_t docs;
+    /*! @member doc_count
+     * Number of ir_doc records.
+     */
+    uint32_t doc_count;
+    /*! @member sections
+     * Offset of the sections of every doc.
+     */
+    uint32_t sections;
+    /*! @member section_count
+     * Number of sections.
+     */
+    uint32_t section_count;
+};
+
+/*!
+ * @macro IR_HAS_SOURCE
+ * Flag of an ir_doc whose doc has associated source code.
+ */
+#define IR_HAS_SOURCE 1u
+/*!
+ * @macro IR_SOURCE_ELIDED
+ * Flag of an ir_doc whose source ends in a function body that was not
+ * captured.
+ */
+#define IR_SOURCE_ELIDED 2u
+
+/*!
+ * @struct ir_doc
+ * A doc within an ir_chunk, referring to its sections by index instead of
+ * by pointer.
+ */
+struct ir_doc
+{
+    /*! @member section_first
+     * Index of the first section of the doc in the sections of the chunk.
+     */
+    uint32_t section_first;
+    /*! @member section_count
+     * Number of sections of the doc.
+     */
+    uint32_t section_count;
+    /*! @member source_start
+     * Line index of the first line of source code of the doc in the text of
+     * the chunk.
+     */
+    uint32_t source_start;
+    /*! @member source_len
+     * Number of lines of source code of the doc.
+     */
+    uint32_t source_len;
+    /*! @member flags
+     * Combination of IR_HAS_SOURCE and IR_SOURCE_ELIDED.
+     */
+    uint32_t flags;
+};
+
+/*!
+ * @variable ir_renderer
+ * Renderer of the hidden target that collects the ir_chunk of each file
+ * for options->emit_ir.
+ */
+static struct renderer const ir_renderer;
+/*!
+ * @function write_ir
+ * Write the IR file at path from the size bytes of consecutive chunks at
+ * data, replacing any existing file atomically.
+ * The chunks are those of files yielded by walk, in the same order.
+ */
+static void
+write_ir(
+    char const* path, char const* data, size_t size, struct walk const* walk);
+/*!
+ * @function run_ir
+ * Render the docs of every file in the IR files options->from_ir to outs,
+ * as if each file had been parsed by a job of its own.
+ * The IR files are mapped and validated once, after which the docs are
+ * rendered in place.
+ * The files of IR files written by the shards of one run are rendered in
+ * the order of an unsharded run, and otherwise in argument order.
+ * Returns the number of files in the IR files.
+ */
+static size_t
+run_ir(struct options const* options, struct sink* outs, struct stats* totals);
+/*!
+ * @function compare_ir_files
+ * Comparison function for sorting ir_file records by position with qsort,
+ * files of equal position being ordered by IR file.
+ */
+static int
+compare_ir_files(void const* lhs, void const* rhs);
+/*!
+ * @function ir_chunk_is_valid
+ * Returns true if the size bytes at chunk hold an ir_chunk whose every
+ * offset, index, and length lies within the chunk, so that rendering it
+ * never reads outside of it.
+ */
+static bool
+ir_chunk_is_valid(char const* chunk, size_t size);
+/*!
+ * @function render_ir_chunk
+ * Render the docs of the validated IR chunk for job->path to job->outs.
+ */
+static void
+render_ir_chunk(struct job* job, char const* chunk);
+
+int
+main(int argc, char** argv)
+{
+    struct options options = {0};
+    options.jobs = 1;
+    options.targets = xalloc(NULL, (size_t)argc * sizeof(*options.targets));
+    memset(options.targets, 0, (size_t)argc * sizeof(*options.targets));
+    options.from_ir = xalloc(NULL, (size_t)argc * sizeof(*options.from_ir));
+    struct renderer const* format = find_renderer("html");
+    struct walk walk = {0};
+    bool shard_by_size = false;
+
+    // The merge command renders IR files named by its arguments.
+    bool const merge = argc > 1 && strcmp(argv[1], "merge") == 0;
+    bool parse_options = true;
+    for (int i = 1 + merge; i < argc; ++i) {
+        char const* const arg = argv[i];
+        if (parse_options && strcmp(arg, "--help") == 0) {
+            usage();
+        }
+        if (parse_options && strcmp(arg, "--version") == 0) {
+            version();
+        }
+        if (parse_options && strcmp(arg, "--md") == 0) {
+            format = find_renderer("md");
+            continue;
+        }
+        if (parse_options && strcmp(arg, "--format") == 0) {
+            if (i + 1 == argc) {
+                errorf("Option --format requires an argument");
+            }
+            format = find_renderer(argv[++i]);
+            if (format == NULL) {
+                errorf("Unknown output format '%s'", argv[i]);
+            }
+            continue;
+        }
+        if (parse_options && strcmp(arg, "--highlight") == 0) {
+            options.highlight = true;
+            continue;
+        }
+        if (parse_options && strcmp(arg, "--out") == 0) {
+            if (i + 1 == argc) {
+                errorf("Option --out requires an argument");
+            }
+            char* const spec = argv[++i];
+            char* const eq = strchr(spec, '=');
+            if (eq == NULL || eq[1] == '\0') {
+                errorf("Invalid output '%s', expected FMT=FILE", spec);
+            }
+            *eq = '\0';
+            struct target* const t = &options.targets[options.target_count];
+            t->renderer = find_renderer(spec);
+            t->path = eq + 1;
+            if (t->renderer == NULL) {
+                errorf("Unknown output format '%s'", spec);
+            }
+            options.target_count += 1;
+            continue;
+        }
+        if (parse_options && strcmp(arg, "-j") == 0) {
+            if (i + 1 == argc) {
+                errorf("Option -j requires an argument");
+            }
+            char* end;
+            long const jobs = strtol(argv[++i], &end, 10);
+            if (*argv[i] == '\0' || *end != '\0' || jobs < 1 || jobs > 1024) {
+                errorf("Invalid number of jobs '%s'", argv[i]);
+            }
+            options.jobs = (int)jobs;
+            continue;
+        }
+        if (parse_options && strcmp(arg, "--keep-going") == 0) {
+            options.keep_going = true;
+            continue;
+        }
+        if (parse_options && strcmp(arg, "--stats") == 0) {
+            options.stats = true;
+            continue;
+        }
+        if (parse_options && strcmp(arg, "--stream") == 0) {
+            options.stream = true;
+            continue;
+        }
+        if (parse_options && strcmp(arg, "--max-memory") == 0) {
+            if (i + 1 == argc) {
+                errorf("Option --max-memory requires an argument");
+            }
+            if (!parse_size(argv[++i], &options.max_memory)
+                || options.max_memory == 0) {
+                errorf("Invalid memory size '%s'", argv[i]);
+            }
+            if (options.max_memory < STREAM_MIN_MEMORY) {
+                errorf(
+                    "Memory size '%s' is below the minimum of %d bytes",
+                    argv[i],
+                    STREAM_MIN_MEMORY);
+            }
+            continue;
+        }
+        if (parse_options && strcmp(arg, "--only") == 0) {
+            if (i + 1 == argc) {
+                errorf("Option --only requires an argument");
+            }
+            add_tag_patterns(argv[++i], &options.only, &options.only_count);
+            continue;
+        }
+        if (parse_options && strcmp(arg, "--exclude-tag") == 0) {
+            if (i + 1 == argc) {
+                errorf("Option --exclude-tag requires an argument");
+            }
+            add_tag_patterns(
+                argv[++i], &options.exclude_tags, &options.exclude_tag_count);
+            continue;
+        }
+        if (parse_options && strcmp(arg, "--name") == 0) {
+            if (i + 1 == argc) {
+                errorf("Option --name requires an argument");
+            }
+            add_name_pattern(argv[++i], &options.names, &options.name_count);
+            continue;
+        }
+        if (parse_options && strcmp(arg, "--exclude-name") == 0) {
+            if (i + 1 == argc) {
+                errorf("Option --exclude-name requires an argument");
+            }
+            add_name_pattern(
+                argv[++i],
+                &options.exclude_names,
+                &options.exclude_name_count);
+            continue;
+        }
+        if (parse_options && strcmp(arg, "-r") == 0) {
+            if (i + 1 == argc) {
+                errorf("Option -r requires an argument");
+            }
+            walk_add(&walk, argv[++i], true);
+            continue;
+        }
+        if (parse_options && strcmp(arg, "--include") == 0) {
+            if (i + 1 == argc) {
+                errorf("Option --include requires an argument");
+            }
+            add_name_pattern(
+                argv[++i], &options.includes, &options.include_count);
+            continue;
+        }
+        if (parse_options && strcmp(arg, "--exclude") == 0) {
+            if (i + 1 == argc) {
+                errorf("Option --exclude requires an argument");
+            }
+            add_name_pattern(
+                argv[++i], &options.excludes, &options.exclude_count);
+            continue;
+        }
+        if (parse_options && strcmp(arg, "--emit-ir") == 0) {
+            if (i + 1 == argc) {
+                errorf("Option --emit-ir requires an argument");
+            }
+            options.emit_ir = argv[++i];
+            continue;
+        }
+        if (parse_options && strcmp(arg, "--from-ir") == 0) {
+            if (i + 1 == argc) {
+                errorf("Option --from-ir requires an argument");
+            }
+            options.from_ir[options.from_ir_count++] = argv[++i];
+            continue;
+        }
+        if (parse_options && strcmp(arg, "--shard") == 0) {
+            if (i + 1 == argc) {
+                errorf("Option --shard requires an argument");
+            }
+            char* end;
+            long const shard = strtol(argv[++i], &end, 10);
+            long count = 0;
+            if (*end == '/' && end[1] >= '0' && end[1] <= '9') {
+                count = strtol(end + 1, &end, 10);
+            }
+            if (*argv[i] < '0' || *argv[i] > '9' || *end != '\0'
+                || count < 1 || count > MAX_SHARD_COUNT || shard < 1
+                || shard > count) {
+                errorf("Invalid shard '%s', expected K/N", argv[i]);
+            }
+            walk.shard = (size_t)shard - 1;
+            walk.shard_count = (size_t)count;
+            continue;
+        }
+        if (parse_options && strcmp(arg, "--shard-by-size") == 0) {
+            shard_by_size = true;
+            continue;
+        }
+        if (parse_options && strcmp(arg, "--output-dir") == 0) {
+            if (i + 1 == argc) {
+                errorf("Option --output-dir requires an argument");
+            }
+            options.output_dir = argv[++i];
+            continue;
+        }
+        if (parse_options && strcmp(arg, "--index") == 0) {
+            if (i + 1 == argc) {
+                errorf("Option --index requires an argument");
+            }
+            options.index_path = argv[++i];
+            continue;
+        }
+        if (parse_options && strcmp(arg, "--search-index") == 0) {
+            if (i + 1 == argc) {
+                errorf("Option --search-index requires an argument");
+            }
+            options.search_index = argv[++i];
+            continue;
+        }
+        if (parse_options && strcmp(arg, "--watch") == 0) {
+            if (i + 1 == argc) {
+                errorf("Option --watch requires an argument");
+            }
+            options.watch_dir = argv[++i];
+            continue;
+        }
+        if (parse_options && strcmp(arg, "--cache") == 0) {
+            if (i + 1 == argc) {
+                errorf("Option --cache requires an argument");
+            }
+            options.cache_dir = argv[++i];
+            continue;
+        }
+        if (parse_options && strcmp(arg, "--") == 0) {
+            parse_options = false;
+            continue;
+        }
+        if (merge) {
+            options.from_ir[options.from_ir_count++] = arg;
+            continue;
+        }
+        walk_add(&walk, arg, false);
+    }
+    if (merge && options.from_ir_count == 0) {
+        errorf("Command merge requires IR files");
+    }
+    if (options.max_memory != 0 && options.cache_dir != NULL) {
+        errorf("Option --max-memory cannot be used with --cache");
+    }
+    if (options.watch_dir != NULL && walk.args.entry_count != 0) {
+        errorf("Option --watch does not take FILE or -r arguments");
+    }
+    if (shard_by_size) {
+        if (walk.shard_count == 0) {
+            errorf("Option --shard-by-size requires --shard");
+        }
+        walk.shard_loads =
+            xalloc(NULL, walk.shard_count * sizeof(*walk.shard_loads));
+        memset(
+            walk.shard_loads, 0, walk.shard_count * sizeof(*walk.shard_loads));
+    }
+    if (walk.shard_count != 0
+        && (options.from_ir_count != 0 || options.watch_dir != NULL)) {
+        errorf("Option --shard cannot be used with --from-ir or --watch");
+    }
+    if (options.from_ir_count != 0) {
+        if (walk.args.entry_count != 0) {
+            errorf("Option --from-ir does not take FILE or -r arguments");
+        }
+        if (options.emit_ir != NULL || options.watch_dir != NULL) {
+            errorf("Option --from-ir cannot be used with --emit-ir or --watch");
+        }
+    }
+    else if (walk.args.entry_count == 0) {
+        walk_add(&walk, "-", false);
+    }
+    if (options.emit_ir != NULL
+        && (options.stream || options.max_memory != 0
+            || options.watch_dir != NULL)) {
+        errorf(
+            "Option --emit-ir cannot be used with --stream, --max-memory, or "
+            "--watch");
+    }
+    if (options.search_index != NULL && options.watch_dir != NULL) {
+        errorf("Option --search-index cannot be used with --watch");
+    }
+    if (options.output_dir != NULL) {
+        if (options.watch_dir != NULL) {
+            errorf("Option --output-dir cannot be used with --watch");
+        }
+        for (size_t i = 0; i < walk.args.entry_count; ++i) {
+            if (strcmp(walk.args.entries[i].path, "-") == 0) {
+                errorf("Option --output-dir requires FILE or -r arguments");
+            }
+        }
+        mode_t const mask = umask(0);
+        umask(mask);
+        options.output_mode = 0666 & ~mask;
+        struct target* const t = &options.targets[options.target_count++];
+        t->renderer = format;
+        t->path = NULL;
+        t->per_file = true;
+    }
+
+    if (options.target_count == 0) {
+        options.targets[0].renderer = format;
+        options.targets[0].path = "-";
+        options.target_count = 1;
+    }
+    for (size_t t = 0; options.highlight && t < options.target_count; ++t) {
+        if (options.targets[t].renderer == find_renderer("html")) {
+            options.targets[t].renderer = &html_highlight_renderer;
+        }
+    }
+    if (options.emit_ir != NULL) {
+        struct target* const t = &options.targets[options.target_count++];
+        t->renderer = &ir_renderer;
+        t->path = NULL;
+    }
+    if (options.search_index != NULL) {
+        struct target* const t = &options.targets[options.target_count++];
+        t->renderer = &search_renderer;
+        t->path = NULL;
+    }
+    if (options.index_path != NULL) {
+        struct target* const t = &options.targets[options.target_count++];
+        t->renderer = &symbol_renderer;
+        t->path = NULL;
+    }
+    if (options.cache_dir != NULL && mkdir(options.cache_dir, 0777) != 0
+        && errno != EEXIST) {
+        errorf("%s: %s", options.cache_dir, strerror(errno));
+    }
+    if (options.watch_dir != NULL) {
+        for (size_t i = 0; i < options.target_count; ++i) {
+            char const* const path = options.targets[i].path;
+            if (path != NULL && strcmp(path, "-") == 0) {
+                errorf("Option --watch requires --out FMT=FILE");
+            }
+        }
+        // A watch outlives any single error, which is reported once and
+        // then waits for the file to be fixed.
+        options.keep_going = true;
+        run_watch(&options);
+    }
+
+    struct sink* const outs =
+        xalloc(NULL, options.target_count * sizeof(*outs));
+    for (size_t i = 0; i < options.target_count; ++i) {
+        char const* const path = options.targets[i].path;
+        if (path == NULL) {
+            sink_init_memory(&outs[i]);
+            continue;
+        }
+        int fd = STDOUT_FILENO;
+        if (strcmp(path, "-") != 0) {
+            fd = open(path, O_WRONLY | O_CREAT | O_TRUNC, 0666);
+            if (fd < 0) {
+                errorf("%s: %s", path, strerror(errno));
+            }
+        }
+        sink_init_fd(&outs[i], fd);
+    }
+
+    struct stats totals = {0};
+    size_t file_count = 0;
+    walk_start(&walk);
+    if (options.from_ir_count != 0) {
+        file_count = run_ir(&options, outs, &totals);
+    }
+    else if (options.jobs > 1
+        && (walk.args.entry_count > 1 || walk.pending != NULL)) {
+        run_parallel(&options, &walk, outs, &totals);
+    }
+    else {
+        struct arena arena = {0};
+        struct symtab pages = {0};
+        for (;;) {
+            struct walk_entry const* const entry = walk_next(&walk);
+            if (entry == NULL && walk.depth == 0) {
+                break;
+            }
+            if (entry == NULL) {
+                struct walk_dir* const dir = walk.pending;
+                walk.pending = dir->next;
+                walk_list_dir(&options, dir);
+                walk_listed(&walk, dir);
+                continue;
+            }
+            struct job job = {0};
+            job.options = &options;
+            job.path = entry->path;
+            job.open_errno = entry->dir != NULL ? entry->dir->error : 0;
+            job.outs = outs;
+            job.arena = &arena;
+            claim_page(&pages, &job);
+            run_job(&job);
+            finish_job(&job, outs, &totals);
+        }
+        symtab_free(&pages);
+        arena_free(&arena);
+    }
+    if (options.stats) {
+        totals.peak_rss = peak_rss();
+        print_stats("total", &totals);
+    }
+    if (options.index_path != NULL) {
+        struct sink const* const symbols = &outs[options.target_count - 1];
+        int const fd =
+            open(options.index_path, O_WRONLY | O_CREAT | O_TRUNC, 0666);
+        if (fd < 0) {
+            errorf("%s: %s", options.index_path, strerror(errno));
+        }
+        struct sink index;
+        sink_init_fd(&index, fd);
+        render_index(&options, symbols->buf, symbols->size, &index);
+        sink_flush(&index);
+        if (close(fd) != 0 && index.error == 0) {
+            index.error = errno;
+        }
+        if (index.error != 0) {
+            errorf(
+                "Failed to write %s: %s",
+                options.index_path,
+                strerror(index.error));
+        }
+        sink_free(&index);
+    }
+
+    for (size_t i = 0; i < options.target_count; ++i) {
+        char const* const path = options.targets[i].path;
+        if (options.targets[i].renderer == &ir_renderer) {
+            write_ir(options.emit_ir, outs[i].buf, outs[i].size, &walk);
+        }
+        if (options.targets[i].renderer == &search_renderer) {
+            struct sink index;
+            sink_init_memory(&index);
+            render_search_index(&options, outs[i].buf, outs[i].size, &index);
+            struct iovec whole;
+            whole.iov_base = index.buf;
+            whole.iov_len = index.size;
+            mode_t const mask = umask(0);
+            umask(mask);
+            int const error =
+                replace_file(options.search_index, &whole, 1, 0666 & ~mask);
+            if (error != 0) {
+                errorf(
+                    "Failed to write %s: %s",
+                    options.search_index,
+                    strerror(error));
+            }
+            sink_free(&index);
+        }
+        if (path == NULL) {
+            sink_free(&outs[i]);
+            continue;
+        }
+        sink_flush(&outs[i]);
+        if (outs[i].fd != STDOUT_FILENO && close(outs[i].fd) != 0) {
+            outs[i].error = outs[i].error != 0 ? outs[i].error : errno;
+        }
+        if (outs[i].error != 0) {
+            errorf(
+                "Failed to write %s: %s",
+                strcmp(path, "-") == 0 ? "output" : path,
+                strerror(outs[i].error));
+        }
+        sink_free(&outs[i]);
+    }
+
+    free(outs);
+    free(options.targets);
+    free(options.from_ir);
+    free(options.only);
+    free(options.exclude_tags);
+    free(options.names);
+    free(options.exclude_names);
+    free(options.includes);
+    free(options.excludes);
+    file_count += walk.file_count;
+    walk_free(&walk);
+    if (totals.failed_files != 0) {
+        errorf(
+            "%" PRIu64 " error(s) in %" PRIu64 " of %zu file(s)",
+            totals.errors,
+            totals.failed_files,
+            file_count);
+    }
+    return EXIT_SUCCESS;
+}
+
+static void
+usage(void)
+{
+    // clang-format off
+    puts(
+        "Usage: cdoc [OPTION]... [--] [FILE]..."                "\n"
+        "  or:  cdoc merge [OPTION]... [--] IR..."              "\n"
+                                                                "\n"
+        "With no FILE, or when FILE is -, read standard input." "\n"
+        "The merge command renders the IR files written with"   "\n"
+        "--emit-ir by the shards of a run as that run would."   "\n"
+                                                                "\n"
+        "Options:"                                              "\n"
+        "  --help      Display usage information and exit."     "\n"
+        "  --version   Display version information and exit."   "\n"
+        "  --md        Output in Markdown format."              "\n"
+        "  --format FMT"                                        "\n"
+        "              Output in format FMT, one of html (the"  "\n"
+        "              default), md, json, or man."             "\n"
+        "  --highlight Mark the keywords, literals, comments, and"  "\n"
+        "              preprocessing directives of the source"  "\n"
+        "              code of HTML output with span classes."  "\n"
+        "  --out FMT=FILE"                                      "\n"
+        "              Write output in format FMT to FILE, or"  "\n"
+        "              to standard output if FILE is -. May be" "\n"
+        "              repeated to write several formats from"  "\n"
+        "              a single parse. Overrides --format."     "\n"
+        "  --output-dir DIR"                                    "\n"
+        "              Write the documentation of each FILE"    "\n"
+        "              to a file of its own below DIR, in the"  "\n"
+        "              format given by --format, replacing"     "\n"
+        "              each file atomically."                   "\n"
+        "  --emit-ir FILE"                                      "\n"
+        "              Also write the parsed docs of every"     "\n"
+        "              FILE to FILE in a binary format that"    "\n"
+        "              --from-ir can render."                   "\n"
+        "  --from-ir FILE"                                      "\n"
+        "              Render the docs stored in FILE by"       "\n"
+        "              --emit-ir instead of reading any FILE."  "\n"
+        "              May be repeated."                        "\n"
+        "  --cache DIR Reuse the output of unchanged files from"  "\n"
+        "              previous runs stored in DIR."            "\n"
+        "  --stream    Write the docs of standard input as they"  "\n"
+        "              are read instead of after the whole"     "\n"
+        "              input has been read."                    "\n"
+        "  --max-memory SIZE"                                   "\n"
+        "              Parse every input as a stream, holding"  "\n"
+        "              at most SIZE bytes of input and parse"   "\n"
+        "              structures per file. SIZE may end in K," "\n"
+        "              M, or G."                                "\n"
+        "  --only TAGS Only document docs whose first section"   "\n"
+        "              has one of the comma-separated TAGS,"    "\n"
+        "              e.g. function,struct."                   "\n"
+        "  --exclude-tag TAGS"                                  "\n"
+        "              Leave out docs with a section having"    "\n"
+        "              one of the comma-separated TAGS."        "\n"
+        "  --name GLOB Only document docs whose name matches"   "\n"
+        "              GLOB. May be repeated."                  "\n"
+        "  --exclude-name GLOB"                                 "\n"
+        "              Leave out docs whose name matches GLOB."  "\n"
+        "              May be repeated."                        "\n"
+        "  --index FILE"                                        "\n"
+        "              Write an HTML index of every documented"  "\n"
+        "              name to FILE, and warn about @see"       "\n"
+        "              sections naming undocumented names,"     "\n"
+        "              or with --output-dir, names documented"  "\n"
+        "              on other pages."                         "\n"
+        "  --search-index FILE"                                 "\n"
+        "              Write a search index of the words of"    "\n"
+        "              every doc to FILE."                      "\n"
+        "  -r DIR      Document the C source and header files"   "\n"
+        "              found under DIR, skipping hidden files"  "\n"
+        "              and directories. May be repeated."       "\n"
+        "  --shard K/N Only document the files of shard K of N,"  "\n"
+        "              assigned by the hash of their path."     "\n"
+        "  --shard-by-size"                                     "\n"
+        "              Assign files to shards by size instead,"  "\n"
+        "              balancing the bytes of each shard."      "\n"
+        "  --include GLOB"                                      "\n"
+        "              Document the files found under a -r"     "\n"
+        "              directory that match GLOB instead. May"  "\n"
+        "              be repeated."                            "\n"
+        "  --exclude GLOB"                                      "\n"
+        "              Skip the files and directories found"    "\n"
+        "              under a -r directory that match GLOB."   "\n"
+        "              May be repeated."                        "\n"
+        "  --watch DIR Document the C source and header files"   "\n"
+        "              of DIR, then document them again"        "\n"
+        "              whenever they change. Requires --out."   "\n"
+        "  --keep-going"                                        "\n"
+        "              Skip docs and files with errors instead"  "\n"
+        "              of exiting at the first error, then"      "\n"
+        "              report the number of errors."            "\n"
+        "  --stats     Report counters and timings of each file"  "\n"
+        "              and of the whole run to stderr."         "\n"
+        "  -j N        Process up to N files in parallel."      "\n"
+    );
+    // clang-format on
+    exit(EXIT_SUCCESS);
+}
+
+static void
+version(void)
+{
+    puts(VERSION);
+    exit(EXIT_SUCCESS);
+}
+#endif
+
+static void
+add_tag_patterns(char* list, struct tag_pattern** patterns, size_t* count)
+{
+    char* tag = list;
+    for (;;) {
+        char* const comma = strchr(tag, ',');
+        if (comma != NULL) {
+            *comma = '\0';
+        }
+        if (*tag == '@') {
+            tag += 1;
+        }
+        if (*tag == '\0') {
+            errorf("Empty tag in tag list");
+        }
+        *patterns = xalloc(*patterns, (*count + 1) * sizeof(**patterns));
+        struct tag_pattern* const p = &(*patterns)[(*count)++];
+        p->str = tag;
+        p->len = strlen(tag);
+        p->tag = find_tag(tag, p->len);
+        if (comma == NULL) {
+            break;
+        }
+        tag = comma + 1;
+    }
+}
+
+static void
+add_name_pattern(char const* glob, char const*** patterns, size_t* count)
+{
+    *patterns = xalloc(*patterns, (*count + 1) * sizeof(**patterns));
+    (*patterns)[(*count)++] = glob;
+}
+
+#if !defined(CDOC_NO_MAIN)
+static bool
+parse_size(char const* str, size_t* size)
+{
+    if (*str < '0' || *str > '9') {
+        return false;
+    }
+    char* end;
+    errno = 0;
+    unsigned long long value = strtoull(str, &end, 10);
+    if (errno != 0) {
+        return false;
+    }
+    int shift = 0;
+    switch (*end) {
+    case 'K':
+        shift = 10;
+        break;
+    case 'M':
+        shift = 20;
+        break;
+    case 'G':
+        shift = 30;
+        break;
+    case '\0':
+        break;
+    default:
+        return false;
+    }
+    if (shift != 0 && *++end != '\0') {
+        return false;
+    }
+    if (value > (SIZE_MAX >> shift)) {
+        return false;
+    }
+    *size = (size_t)value << shift;
+    return true;
+}
+#endif
+
+static void
+errorf(char const* fmt, ...)
+{
+    if (fmt == NULL) {
+        fputs("error: errorf called with NULL format string\n", stderr);
+        goto terminate;
+    }
+
+    va_list args;
+    va_start(args, fmt);
+    fputs("error: ", stderr);
+    vfprintf(stderr, fmt, args);
+    fputs("\n", stderr);
+    va_end(args);
+
+terminate:
+    // Any error should immediately terminate the program.
+    exit(EXIT_FAILURE);
+}
+
+static void*
+xalloc(void* ptr, size_t size)
+{
+    if (size == 0) {
+        free(ptr);
+        return NULL;
+    }
+    if ((ptr = realloc(ptr, size)) == NULL) {
+        errorf("[%s] Out of memory", __func__);
+    }
+    return ptr;
+}
+
+static void*
+arena_alloc(struct arena* a, size_t size)
+{
+    size = (size + ARENA_ALIGN - 1) & ~(size_t)(ARENA_ALIGN - 1);
+    struct arena_block* b = a->block;
+    if (b == NULL || b->size - b->used < size) {
+        size_t block_size = b == NULL ? ARENA_MIN_BLOCK : b->size * 2;
+        while (block_size < size) {
+            block_size *= 2;
+        }
+        struct arena_block* const prev = b;
+        b = xalloc(NULL, ARENA_HEADER_SIZE + block_size);
+        b->prev = prev;
+        b->size = block_size;
+        b->used = 0;
+        a->block = b;
+        a->size += ARENA_HEADER_SIZE + block_size;
+    }
+    a->last = (char*)b + ARENA_HEADER_SIZE + b->used;
+    a->allocations += 1;
+    b->used += size;
+    return a->last;
+}
+
+static void*
+arena_grow(struct arena* a, void* ptr, size_t old_size, size_t new_size)
+{
+    if (ptr != NULL && ptr == a->last) {
+        struct arena_block* const b = a->block;
+        size_t const start =
+            (size_t)((char*)ptr - ((char*)b + ARENA_HEADER_SIZE));
+        size_t const size =
+            (new_size + ARENA_ALIGN - 1) & ~(size_t)(ARENA_ALIGN - 1);
+        if (b->size - start >= size) {
+            b->used = start + size;
+            return ptr;
+        }
+    }
+    void* const grown = arena_alloc(a, new_size);
+    if (ptr != NULL && old_size != 0) {
+        memcpy(grown, ptr, old_size);
+    }
+    return grown;
+}
+
+static void*
+arena_push(
+    struct arena* a,
+    void* ptr,
+    size_t* capacity,
+    size_t count,
+    size_t elem_size)
+{
+    if (count < *capacity) {
+        return ptr;
+    }
+    size_t const old_capacity = *capacity;
+    *capacity = old_capacity == 0 ? 8 : old_capacity * 2;
+    return arena_grow(
+        a, ptr, old_capacity * elem_size, *capacity * elem_size);
+}
+
+#if !defined(CDOC_NO_MAIN)
+static size_t
+arena_used(struct arena const* a)
+{
+    size_t used = 0;
+    for (struct arena_block const* b = a->block; b != NULL; b = b->prev) {
+        used += b->used;
+    }
+    return used;
+}
+#endif
+
+static void
+arena_reset(struct arena* a)
+{
+    struct arena_block* const b = a->block;
+    if (b == NULL) {
+        return;
+    }
+    for (struct arena_block* p = b->prev; p != NULL;) {
+        struct arena_block* const prev = p->prev;
+        a->size -= ARENA_HEADER_SIZE + p->size;
+        free(p);
+        p = prev;
+    }
+    b->prev = NULL;
+    b->used = 0;
+    a->last = NULL;
+}
+
+static void
+arena_free(struct arena* a)
+{
+    arena_reset(a);
+    free(a->block);
+    a->block = NULL;
+    a->size = 0;
+}
+
+#if !defined(CDOC_NO_MAIN)
+static void
+sink_init_fd(struct sink* s, int fd)
+{
+    *s = (struct sink){0};
+    s->fd = fd;
+    s->cap = SINK_BUFFER_SIZE;
+    s->buf = xalloc(NULL, s->cap);
+}
+
+static void
+sink_init_memory(struct sink* s)
+{
+    *s = (struct sink){0};
+    s->fd = -1;
+    s->cap = SINK_BUFFER_SIZE;
+    s->buf = xalloc(NULL, s->cap);
+}
+
+static ALWAYS_INLINE void
+sink_write(struct sink* s, char const* data, size_t size)
+{
+    s->total += size;
+    if (s->cap - s->size >= size) {
+        memcpy(s->buf + s->size, data, size);
+        s->size += size;
+        return;
+    }
+    sink_write_slow(s, data, size);
+}
+
+static void
+sink_write_slow(struct sink* s, char const* data, size_t size)
+{
+    if (s->fd < 0) {
+        size_t cap = s->cap;
+        while (cap - s->size < size) {
+            cap *= 2;
+        }
+        s->buf = xalloc(s->buf, cap);
+        s->cap = cap;
+        memcpy(s->buf + s->size, data, size);
+        s->size += size;
+        return;
+    }
+
+    struct iovec iov[2];
+    iov[0].iov_base = s->buf;
+    iov[0].iov_len = s->size;
+    iov[1].iov_base = (void*)data;
+    iov[1].iov_len = size;
+    sink_writev(s, iov, 2);
+    s->size = 0;
+}
+
+static void
+sink_puts(struct sink* s, char const* str)
+{
+    sink_write(s, str, strlen(str));
+}
+
+static void
+sink_write_line(struct sink* s, char const* data, size_t size)
+{
+    if (s->cap - s->size > size) {
+        memcpy(s->buf + s->size, data, size);
+        s->buf[s->size + size] = '\n';
+        s->size += size + 1;
+        s->total += size + 1;
+        return;
+    }
+    sink_write(s, data, size);
+    sink_write(s, "\n", 1);
+}
+
+static void
+sink_write_varint(struct sink* s, uint64_t value)
+{
+    char bytes[10];
+    size_t size = 0;
+    while (value >= 0x80) {
+        bytes[size++] = (char)((value & 0x7f) | 0x80);
+        value >>= 7;
+    }
+    bytes[size++] = (char)value;
+    sink_write(s, bytes, size);
+}
+
+static void
+sink_flush(struct sink* s)
+{
+    if (s->fd < 0 || s->size == 0) {
+        return;
+    }
+    struct iovec iov;
+    iov.iov_base = s->buf;
+    iov.iov_len = s->size;
+    sink_writev(s, &iov, 1);
+    s->size = 0;
+}
+
+static void
+sink_writev(struct sink* s, struct iovec* iov, int count)
+{
+    while (count > 0 && s->error == 0) {
+        ssize_t n = writev(s->fd, iov, count);
+        if (n < 0) {
+            if (errno != EINTR) {
+                s->error = errno;
+            }
+            continue;
+        }
+        while (count > 0 && (size_t)n >= iov->iov_len) {
+            n -= (ssize_t)iov->iov_len;
+            iov += 1;
+            count -= 1;
+        }
+        if (count > 0) {
+            iov->iov_base = (char*)iov->iov_base + n;
+            iov->iov_len -= (size_t)n;
+        }
+    }
+}
+
+static void
+sink_free(struct sink* s)
+{
+    free(s->buf);
+    s->buf = NULL;
+    s->size = 0;
+    s->cap = 0;
+}
+#endif
+
+static bool
+job_errorf(struct job* job, char const* fmt, ...)
+{
+    va_list args;
+    va_start(args, fmt);
+    int const len = vsnprintf(NULL, 0, fmt, args);
+    va_end(args);
+
+    char* const error = xalloc(NULL, (size_t)len + 1);
+    va_start(args, fmt);
+    vsnprintf(error, (size_t)len + 1, fmt, args);
+    va_end(args);
+
+    job->errors = xalloc(
+        job->errors, (job->error_count + 1) * sizeof(*job->errors));
+    job->errors[job->error_count++] = error;
+    return false;
+}
+
+#if !defined(CDOC_NO_MAIN)
+static void
+add_stats(struct stats* to, struct stats const* from)
+{
+    to->files += from->files;
+    to->bytes += from->bytes;
+    to->lines += from->lines;
+    to->docs += from->docs;
+    to->sections += from->sections;
+    to->source_lines += from->source_lines;
+    to->allocations += from->allocations;
+    to->output_bytes += from->output_bytes;
+    to->errors += from->errors;
+    to->failed_files += from->failed_files;
+    to->read += from->read;
+    to->split += from->split;
+    to->parse += from->parse;
+    to->render += from->render;
+    if (from->memory > to->memory) {
+        to->memory = from->memory;
+    }
+}
+
+static uint64_t
+peak_rss(void)
+{
+    struct rusage usage;
+    if (getrusage(RUSAGE_SELF, &usage) != 0) {
+        return 0;
+    }
+#if defined(__APPLE__)
+    return (uint64_t)usage.ru_maxrss;
+#else
+    return (uint64_t)usage.ru_maxrss * 1024;
+#endif
+}
+
+static void
+print_stats(char const* label, struct stats const* stats)
+{
+    fprintf(
+        stderr,
+        "stats: %s files=%" PRIu64 " bytes=%" PRIu64 " lines=%" PRIu64
+        " docs=%" PRIu64 " sections=%" PRIu64 " source_lines=%" PRIu64
+        " allocations=%" PRIu64 " output_bytes=%" PRIu64 " errors=%" PRIu64
+        " read=%.6f split=%.6f parse=%.6f render=%.6f memory=%" PRIu64,
+        label,
+        stats->files,
+        stats->bytes,
+        stats->lines,
+        stats->docs,
+        stats->sections,
+        stats->source_lines,
+        stats->allocations,
+        stats->output_bytes,
+        stats->errors,
+        stats->read,
+        stats->split,
+        stats->parse,
+        stats->render,
+        stats->memory);
+    if (stats->peak_rss != 0) {
+        fprintf(stderr, " peak_rss=%" PRIu64, stats->peak_rss);
+    }
+    fputc('\n', stderr);
+}
+#endif
+
+static void
+lap(struct job* job, double* phase, double* start)
+{
+    if (!job->options->stats) {
+        return;
+    }
+    double const now = clock_seconds();
+    *phase += now - *start;
+    *start = now;
+}
+
+static double
+clock_seconds(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (double)ts.tv_sec + (double)ts.tv_nsec * 1e-9;
+}
+
+#if !defined(CDOC_NO_MAIN)
+static bool
+run_job(struct job* job)
+{
+    // A directory that failed to be listed is reported like a file that
+    // failed to open, and a file whose page was claimed by an earlier file
+    // is not documented.
+    if (job->open_errno != 0 || job->error_count != 0) {
+        return false;
+    }
+    bool const use_stdin = strcmp(job->path, "-") == 0;
+    FILE* const fp = use_stdin ? stdin : fopen(job->path, "rb");
+    if (fp == NULL) {
+        job->open_errno = errno;
+        return false;
+    }
+    uint64_t const allocations = job->arena->allocations;
+    uint64_t output_bytes = 0;
+    for (size_t t = 0; t < job->options->target_count; ++t) {
+        output_bytes -= job->outs[t].total;
+    }
+
+    bool ok;
+    if ((use_stdin && job->options->stream) || job->options->max_memory != 0) {
+        ok = do_stream(job, fp);
+    }
+    else if (job->options->cache_dir != NULL && !use_stdin) {
+        ok = do_cached_file(job, fp);
+    }
+    else {
+        ok = do_file(job, fp);
+    }
+    if (!use_stdin) {
+        fclose(fp);
+    }
+
+    for (size_t t = 0; t < job->options->target_count; ++t) {
+        output_bytes += job->outs[t].total;
+    }
+    job->stats.files = 1;
+    job->stats.output_bytes = output_bytes;
+    job->stats.allocations = job->arena->allocations - allocations;
+
+    // Each worker writes the files of its own jobs, so that the output of
+    // different files is written concurrently.
+    if (job->options->output_dir != NULL
+        && (ok || job->options->keep_going)) {
+        ok = write_file_outputs(job) && ok;
+    }
+    return ok;
+}
+
+static bool
+write_file_outputs(struct job* job)
+{
+    bool ok = true;
+    for (size_t t = 0; t < job->options->target_count; ++t) {
+        struct target const* const target = &job->options->targets[t];
+        if (!target->per_file) {
+            continue;
+        }
+        struct sink* const out = &job->outs[t];
+        char* const path =
+            output_file_path(job->options, job->path, target->renderer);
+        int error = make_parent_dirs(path);
+        if (error == 0) {
+            struct iovec part;
+            part.iov_base = out->buf;
+            part.iov_len = out->size;
+            error = replace_file(path, &part, 1, job->options->output_mode);
+        }
+        if (error != 0) {
+            ok = job_errorf(
+                job, "Failed to write %s: %s", path, strerror(error));
+        }
+        out->size = 0;
+        free(path);
+    }
+    return ok;
+}
+
+static char*
+output_file_path(
+    struct options const* options,
+    char const* path,
+    struct renderer const* renderer)
+{
+    size_t const dir_len = strlen(options->output_dir);
+    size_t const name_len = strlen(renderer->name);
+    // Each component grows by at most one dot.
+    char* const out = xalloc(NULL, dir_len + 2 * strlen(path) + name_len + 3);
+    memcpy(out, options->output_dir, dir_len);
+    size_t len = dir_len;
+    for (char const* cp = path; *cp != '\0';) {
+        char const* const slash = strchr(cp, '/');
+        size_t const n = slash != NULL ? (size_t)(slash - cp) : strlen(cp);
+        size_t dots = 0;
+        while (dots < n && cp[dots] == '.') {
+            dots += 1;
+        }
+        if (n != 0 && !(n == 1 && dots == 1)) {
+            if (len != 0 && out[len - 1] != '/') {
+                out[len++] = '/';
+            }
+            memcpy(out + len, cp, n);
+            len += n;
+            if (dots == n) {
+                out[len++] = '.';
+            }
+        }
+        cp += n + (slash != NULL);
+    }
+    out[len++] = '.';
+    memcpy(out + len, renderer->name, name_len + 1);
+    return out;
+}
+
+static bool
+claim_page(struct symtab* pages, struct job* job)
+{
+    struct options const* const options = job->options;
+    bool ok = true;
+    for (size_t t = 0; t < options->target_count; ++t) {
+        struct target const* const target = &options->targets[t];
+        if (!target->per_file) {
+            continue;
+        }
+        char* const page =
+            output_file_path(options, job->path, target->renderer);
+        size_t const len = strlen(page);
+        uint32_t const first = symtab_find(pages, page, len);
+        if (first != SYMBOL_NONE) {
+            ok = job_errorf(
+                job,
+                "Page %s is also the page of %s",
+                page,
+                pages->pool + pages->symbols[first].path);
+        }
+        else {
+            uint32_t const path =
+                symtab_intern(pages, job->path, strlen(job->path))->offset
+                - 1;
+            symtab_add(pages, page, len, SYMBOL_NONE, path, SYMBOL_NONE);
+        }
+        free(page);
+    }
+    return ok;
+}
+
+static int
+make_parent_dirs(char* path)
+{
+    for (char* cp = strchr(path + 1, '/'); cp != NULL;
+         cp = strchr(cp + 1, '/')) {
+        *cp = '\0';
+        // Another worker may create the same directory concurrently.
+        int const error = mkdir(path, 0777) != 0 && errno != EEXIST ? errno : 0;
+        *cp = '/';
+        if (error != 0) {
+            return error;
+        }
+    }
+    return 0;
+}
+
+static void
+finish_job(struct job* job, struct sink* outs, struct stats* totals)
+{
+    bool const failed = job->open_errno != 0 || job->error_count != 0;
+    job->stats.errors = job->error_count + (job->open_errno != 0);
+    job->stats.failed_files = failed;
+    if (job->options->stats && job->open_errno == 0) {
+        print_stats(job->path, &job->stats);
+    }
+    add_stats(totals, &job->stats);
+    if (!failed) {
+        return;
+    }
+
+    for (size_t i = 0; i < job->options->target_count; ++i) {
+        sink_flush(&outs[i]);
+    }
+    if (job->open_errno != 0) {
+        if (!job->options->keep_going) {
+            errorf("%s: %s", job->path, strerror(job->open_errno));
+        }
+        fprintf(
+            stderr, "error: %s: %s\n", job->path, strerror(job->open_errno));
+    }
+    if (job->error_count != 0 && !job->options->keep_going) {
+        errorf("%s", job->errors[0]);
+    }
+    for (size_t i = 0; i < job->error_count; ++i) {
+        fprintf(stderr, "error: %s: %s\n", job->path, job->errors[i]);
+    }
+    clear_errors(job);
+}
+
+static void
+run_parallel(
+    struct options const* options,
+    struct walk* walk,
+    struct sink* outs,
+    struct stats* totals)
+{
+    struct symtab pages = {0};
+    struct pool pool = {0};
+    pool.options = options;
+    pool.walk = walk;
+    pool.pages = &pages;
+    pool.window = (size_t)options->jobs * 4;
+    pool_advance(&pool);
+    pthread_mutex_init(&pool.lock, NULL);
+    pthread_cond_init(&pool.cond, NULL);
+
+    size_t thread_count = (size_t)options->jobs;
+    if (pool.complete && pool.job_count < thread_count) {
+        thread_count = pool.job_count;
+    }
+    pthread_t* const threads = xalloc(NULL, thread_count * sizeof(*threads));
+    for (size_t i = 0; i < thread_count; ++i) {
+        if (pthread_create(&threads[i], NULL, pool_worker, &pool) != 0) {
+            errorf("Failed to create worker thread");
+        }
+    }
+
+    // Write each job's output in walk order as soon as it is done.
+    struct arena arena = {0};
+    for (size_t i = 0;; ++i) {
+        pthread_mutex_lock(&pool.lock);
+        while (i == pool.job_count && !pool.complete) {
+            pthread_cond_wait(&pool.cond, &pool.lock);
+        }
+        if (i == pool.job_count) {
+            pthread_mutex_unlock(&pool.lock);
+            break;
+        }
+        struct job* const job = pool.jobs[i];
+        while (!job->done) {
+            pthread_cond_wait(&pool.cond, &pool.lock);
+        }
+        pthread_mutex_unlock(&pool.lock);
+
+        if (strcmp(job->path, "-") == 0) {
+            job->outs = outs;
+            job->arena = &arena;
+            run_job(job);
+        }
+        else {
+            for (size_t t = 0; t < options->target_count; ++t) {
+                struct sink* const buffer = &job->buffers[t];
+                sink_write(&outs[t], buffer->buf, buffer->size);
+                sink_free(buffer);
+            }
+            free(job->buffers);
+        }
+        finish_job(job, outs, totals);
+
+        pthread_mutex_lock(&pool.lock);
+        pool.flushed += 1;
+        pthread_cond_broadcast(&pool.cond);
+        pthread_mutex_unlock(&pool.lock);
+    }
+
+    for (size_t i = 0; i < thread_count; ++i) {
+        pthread_join(threads[i], NULL);
+    }
+    arena_free(&arena);
+    free(threads);
+    pthread_cond_destroy(&pool.cond);
+    pthread_mutex_destroy(&pool.lock);
+    for (size_t i = 0; i < pool.job_count; ++i) {
+        free(pool.jobs[i]);
+    }
+    free(pool.jobs);
+    symtab_free(&pages);
+}
+
+static void
+pool_advance(struct pool* pool)
+{
+    struct walk_entry const* entry;
+    while ((entry = walk_next(pool->walk)) != NULL) {
+        if (pool->job_count == pool->job_cap) {
+            pool->job_cap = pool->job_cap == 0 ? 64 : pool->job_cap * 2;
+            pool->jobs =
+                xalloc(pool->jobs, pool->job_cap * sizeof(*pool->jobs));
+        }
+        struct job* const job = xalloc(NULL, sizeof(*job));
+        *job = (struct job){0};
+        job->options = pool->options;
+        job->path = entry->path;
+        job->open_errno = entry->dir != NULL ? entry->dir->error : 0;
+        claim_page(pool->pages, job);
+        pool->jobs[pool->job_count++] = job;
+    }
+    pool->complete = pool->walk->depth == 0;
+}
+
+static void*
+pool_worker(void* arg)
+{
+    struct pool* const pool = arg;
+    struct arena arena = {0};
+
+    pthread_mutex_lock(&pool->lock);
+    for (;;) {
+        // Directories are listed while fewer than a window of jobs are
+        // waiting to start, keeping discovery ahead of rendering without
+        // holding the whole tree in jobs.
+        struct walk_dir* const dir = pool->walk->pending;
+        if (dir != NULL && pool->job_count - pool->next < pool->window) {
+            pool->walk->pending = dir->next;
+            pthread_mutex_unlock(&pool->lock);
+            walk_list_dir(pool->options, dir);
+            pthread_mutex_lock(&pool->lock);
+            walk_listed(pool->walk, dir);
+            pool_advance(pool);
+            pthread_cond_broadcast(&pool->cond);
+            continue;
+        }
+        if (pool->next == pool->job_count
+            || pool->next - pool->flushed >= pool->window) {
+            if (pool->complete && pool->next == pool->job_count) {
+                break;
+            }
+            pthread_cond_wait(&pool->cond, &pool->lock);
+            continue;
+        }
+        struct job* const job = pool->jobs[pool->next++];
+        pthread_mutex_unlock(&pool->lock);
+
+        // Standard input is left for the sequencer to read in argument
+        // order, so that repeated "-" arguments behave as they would
+        // sequentially.
+        if (strcmp(job->path, "-") != 0) {
+            size_t const target_count = job->options->target_count;
+            job->buffers =
+                xalloc(NULL, target_count * sizeof(*job->buffers));
+            for (size_t t = 0; t < target_count; ++t) {
+                sink_init_memory(&job->buffers[t]);
+            }
+            job->outs = job->buffers;
+            job->arena = &arena;
+            run_job(job);
+        }
+
+        pthread_mutex_lock(&pool->lock);
+        job->done = true;
+        pthread_cond_broadcast(&pool->cond);
+    }
+    pthread_mutex_unlock(&pool->lock);
+    arena_free(&arena);
+    return NULL;
+}
+
+static void
+walk_add(struct walk* walk, char const* path, bool recurse)
+{
+    struct walk_dir* const args = &walk->args;
+    size_t const count = args->entry_count;
+    if ((count & (count - 1)) == 0) {
+        size_t const cap = count == 0 ? 8 : count * 2;
+        args->entries = xalloc(args->entries, cap * sizeof(*args->entries));
+    }
+    struct walk_entry* const entry = &args->entries[args->entry_count++];
+    size_t const len = strlen(path);
+    entry->path = xalloc(NULL, len + 1);
+    memcpy(entry->path, path, len + 1);
+    entry->dir = NULL;
+    if (recurse) {
+        entry->dir = xalloc(NULL, sizeof(*entry->dir));
+        *entry->dir = (struct walk_dir){0};
+        entry->dir->path = entry->path;
+        entry->dir->rel = len + (len != 0 && path[len - 1] != '/');
+    }
+}
+
+static void
+walk_start(struct walk* walk)
+{
+    walk->root.path = NULL;
+    walk->root.dir = &walk->args;
+    walk_listed(walk, &walk->args);
+    walk->stack_cap = 16;
+    walk->stack = xalloc(NULL, walk->stack_cap * sizeof(*walk->stack));
+    walk->stack[0] = (struct walk_frame){&walk->root, 0};
+    walk->depth = 1;
+}
+
+static struct walk_entry const*
+walk_next(struct walk* walk)
+{
+    while (walk->depth != 0) {
+        struct walk_frame* const frame = &walk->stack[walk->depth - 1];
+        struct walk_dir const* const dir = frame->entry->dir;
+        if (!dir->listed) {
+            return NULL;
+        }
+        if (dir->error != 0) {
+            walk->depth -= 1;
+            if (!walk_in_shard(walk, frame->entry)) {
+                continue;
+            }
+            return walk_yield(walk, frame->entry);
+        }
+        if (frame->index == dir->entry_count) {
+            walk->depth -= 1;
+            continue;
+        }
+        struct walk_entry* const entry = &dir->entries[frame->index++];
+        if (entry->dir == NULL) {
+            if (!walk_in_shard(walk, entry)) {
+                continue;
+            }
+            return walk_yield(walk, entry);
+        }
+        if (walk->depth == walk->stack_cap) {
+            walk->stack_cap *= 2;
+            walk->stack =
+                xalloc(walk->stack, walk->stack_cap * sizeof(*walk->stack));
+        }
+        walk->stack[walk->depth++] = (struct walk_frame){entry, 0};
+    }
+    return NULL;
+}
+
+static bool
+walk_in_shard(struct walk* walk, struct walk_entry* entry)
+{
+    entry->position = walk->position++;
+    if (walk->shard_count == 0) {
+        return true;
+    }
+    if (walk->shard_loads == NULL) {
+        uint64_t const hash = hash64(entry->path, strlen(entry->path), 0);
+        return hash % walk->shard_count == walk->shard;
+    }
+    // Each file goes to the shard with the fewest bytes so far, and the
+    // first such shard on a tie. Counting one byte more than the size of
+    // each file spreads empty files as well.
+    size_t shard = 0;
+    for (size_t i = 1; i < walk->shard_count; ++i) {
+        if (walk->shard_loads[i] < walk->shard_loads[shard]) {
+            shard = i;
+        }
+    }
+    struct stat st;
+    bool const sized = entry->dir == NULL && stat(entry->path, &st) == 0;
+    walk->shard_loads[shard] += (sized ? (uint64_t)st.st_size : 0) + 1;
+    return shard == walk->shard;
+}
+
+static struct walk_entry const*
+walk_yield(struct walk* walk, struct walk_entry* entry)
+{
+    size_t const count = walk->file_count;
+    if ((count & (count - 1)) == 0) {
+        size_t const cap = count == 0 ? 8 : count * 2;
+        walk->yielded = xalloc(walk->yielded, cap * sizeof(*walk->yielded));
+    }
+    walk->yielded[walk->file_count++] = entry;
+    return entry;
+}
+
+static void
+walk_list_dir(struct options const* options, struct walk_dir* dir)
+{
+    int const fd = open(dir->path, O_RDONLY | O_DIRECTORY | O_CLOEXEC);
+    DIR* const d = fd < 0 ? NULL : fdopendir(fd);
+    if (d == NULL) {
+        dir->error = errno;
+        if (fd >= 0) {
+            close(fd);
+        }
+        return;
+    }
+    size_t const len = strlen(dir->path);
+    bool const has_slash = len != 0 && dir->path[len - 1] == '/';
+
+    size_t cap = 0;
+    struct dirent* ent;
+    while ((errno = 0, ent = readdir(d)) != NULL) {
+        char const* const name = ent->d_name;
+        if (name[0] == '.') {
+            continue;
+        }
+        bool is_dir = false;
+        bool is_file = false;
+#if defined(DT_DIR)
+        is_dir = ent->d_type == DT_DIR;
+        is_file = ent->d_type == DT_REG;
+#endif
+        if (!is_dir && !is_file) {
+            // Symbolic links are only followed to files, so that a link to
+            // an ancestor cannot make the walk loop.
+            struct stat st;
+            if (fstatat(fd, name, &st, AT_SYMLINK_NOFOLLOW) != 0) {
+                continue;
+            }
+            if (S_ISLNK(st.st_mode)) {
+                is_file =
+                    fstatat(fd, name, &st, 0) == 0 && S_ISREG(st.st_mode);
+            }
+            else {
+                is_dir = S_ISDIR(st.st_mode);
+                is_file = S_ISREG(st.st_mode);
+            }
+            if (!is_dir && !is_file) {
+                continue;
+            }
+        }
+
+        size_t const size = len + strlen(name) + 2;
+        char* const path = xalloc(NULL, size);
+        snprintf(path, size, "%s%s%s", dir->path, has_slash ? "" : "/", name);
+        if (!is_walked_name(options, name, path + dir->rel, is_dir)) {
+            free(path);
+            continue;
+        }
+        if (dir->entry_count == cap) {
+            cap = cap == 0 ? 16 : cap * 2;
+            dir->entries = xalloc(dir->entries, cap * sizeof(*dir->entries));
+        }
+        struct walk_entry* const entry = &dir->entries[dir->entry_count++];
+        entry->path = path;
+        entry->dir = NULL;
+        if (is_dir) {
+            entry->dir = xalloc(NULL, sizeof(*entry->dir));
+            *entry->dir = (struct walk_dir){0};
+            entry->dir->path = path;
+            entry->dir->rel = dir->rel;
+        }
+    }
+    if (errno != 0) {
+        dir->error = errno;
+    }
+    closedir(d);
+    if (dir->entry_count > 1) {
+        qsort(
+            dir->entries,
+            dir->entry_count,
+            sizeof(*dir->entries),
+            compare_walk_entries);
+    }
+}
+
+static void
+walk_listed(struct walk* walk, struct walk_dir* dir)
+{
+    dir->listed = true;
+    // Subdirectories are pushed last to first, so that the first is the
+    // next to be listed.
+    for (size_t i = dir->entry_count; i-- > 0;) {
+        struct walk_dir* const sub = dir->entries[i].dir;
+        if (sub != NULL) {
+            sub->next = walk->pending;
+            walk->pending = sub;
+        }
+    }
+}
+
+static bool
+is_walked_name(
+    struct options const* options,
+    char const* name,
+    char const* rel,
+    bool is_dir)
+{
+    for (size_t i = 0; i < options->exclude_count; ++i) {
+        if (match_walk_glob(options->excludes[i], name, rel)) {
+            return false;
+        }
+    }
+    if (is_dir) {
+        return true;
+    }
+    if (options->include_count == 0) {
+        return is_watched_name(name);
+    }
+    for (size_t i = 0; i < options->include_count; ++i) {
+        if (match_walk_glob(options->includes[i], name, rel)) {
+            return true;
+        }
+    }
+    return false;
+}
+
+static bool
+match_walk_glob(char const* glob, char const* name, char const* rel)
+{
+    if (strchr(glob, '/') != NULL) {
+        return fnmatch(glob, rel, FNM_PATHNAME) == 0;
+    }
+    return fnmatch(glob, name, 0) == 0;
+}
+
+static int
+compare_walk_entries(void const* lhs, void const* rhs)
+{
+    struct walk_entry const* const a = lhs;
+    struct walk_entry const* const b = rhs;
+    return strcmp(a->path, b->path);
+}
+
+static void
+walk_free(struct walk* walk)
+{
+    walk_free_entries(&walk->args);
+    free(walk->stack);
+    free(walk->yielded);
+    free(walk->shard_loads);
+}
+
+static void
+walk_free_entries(struct walk_dir* dir)
+{
+    for (size_t i = 0; i < dir->entry_count; ++i) {
+        struct walk_dir* const sub = dir->entries[i].dir;
+        if (sub != NULL) {
+            walk_free_entries(sub);
+            free(sub);
+        }
+        free(dir->entries[i].path);
+    }
+    free(dir->entries);
+}
+
+static bool
+read_text_file(struct job* job, FILE* stream, struct text* t)
+{
+    *t = (struct text){0};
+
+    if (!map_text_file(fileno(stream), t)) {
+        // Chunked read with geometric growth for pipes and stdin.
+        char* buf = NULL;
+        size_t cap = 0;
+        for (;;) {
+            if (cap - t->size < BUFSIZ) {
+                cap = cap == 0 ? 64 * 1024 : cap * 2;
+                buf = xalloc(buf, cap);
+            }
+            size_t const n = fread(buf + t->size, 1, cap - t->size, stream);
+            t->size += n;
+            if (n == 0) {
+                break;
+            }
+        }
+        t->data = buf;
+        if (!feof(stream)) {
+            free_text(*t);
+            return job_errorf(job, "Failed to read entire text file");
+        }
+    }
+
+    if (memchr(t->data, '\0', t->size) != NULL) {
+        free_text(*t);
+        return job_errorf(job, "Encountered illegal NUL byte");
+    }
+    return true;
+}
+
+static bool
+map_text_file(int fd, struct text* t)
+{
+    struct stat st;
+    if (fd < 0 || fstat(fd, &st) != 0 || !S_ISREG(st.st_mode)) {
+        return false;
+    }
+    size_t const size = (size_t)st.st_size;
+    if (size == 0) {
+        return false;
+    }
+
+    void* const map = mmap(NULL, size, PROT_READ, MAP_PRIVATE, fd, 0);
+    if (map == MAP_FAILED) {
+        return false;
+    }
+    t->data = map;
+    t->size = size;
+    t->map_size = size;
+    return true;
+}
+
+static void
+free_text(struct text t)
+{
+    if (t.map_size != 0) {
+        munmap((void*)t.data, t.map_size);
+    }
+    else {
+        free((void*)t.data);
+    }
+}
+#endif
+
+static bool
+text_to_lines(struct job* job, struct text text, struct file* fp)
+{
+    if (text.size >= UINT32_MAX) {
+        return job_errorf(job, "Text file too large (%zu bytes)", text.size);
+    }
+    struct file f = {0};
+    f.text = text.data;
+
+    size_t line_cap = 0;
+    size_t doc_cap = 0;
+    f.lines = arena_push(job->arena, f.lines, &line_cap, 0, sizeof(*f.lines));
+    if (text.size == 0) {
+        f.lines[0] = 1;
+        *fp = f;
+        return true;
+    }
+    f.lines[f.line_count++] = 0;
+
+#if !defined(HAVE_SSE2_SCAN) && !defined(HAVE_NEON_SCAN)
+    char const* const end = text.data + text.size;
+    char const* cp = text.data;
+    for (;;) {
+        char const* const nl = memchr(cp, '\n', (size_t)(end - cp));
+        if (is_doc_comment(cp, nl != NULL ? nl : end)) {
+            f.doc_lines = arena_push(
+                job->arena,
+                f.doc_lines,
+                &doc_cap,
+                f.doc_line_count,
+                sizeof(*f.doc_lines));
+            f.doc_lines[f.doc_line_count++] = f.line_count - 1;
+        }
+        if (nl == NULL) {
+            break;
+        }
+        cp = nl + 1;
+        f.lines = arena_push(
+            job->arena, f.lines, &line_cap, f.line_count + 1, sizeof(*f.lines));
+        f.lines[f.line_count++] = (uint32_t)(cp - text.data);
+    }
+#else
+    scan_block_fn const scan_block = select_scan_block();
+    char tail[SCAN_BLOCK_SIZE + 2];
+    for (size_t i = 0; i < text.size; i += SCAN_BLOCK_SIZE) {
+        // The final partial block is scanned from a zero-padded copy.
+        char const* p = text.data + i;
+        if (text.size - i < SCAN_BLOCK_SIZE + 2) {
+            memset(tail, 0, sizeof(tail));
+            memcpy(tail, p, text.size - i);
+            p = tail;
+        }
+        uint64_t newlines;
+        uint64_t openers;
+        scan_block(p, &newlines, &openers);
+
+        for (uint64_t m = newlines | openers; m != 0; m &= m - 1) {
+            int const bit = lowest_bit(m);
+            uint32_t const pos = (uint32_t)(i + (size_t)bit);
+            if (openers >> bit & 1) {
+                // Only the first non-whitespace characters may open a doc.
+                char const* cp = text.data + f.lines[f.line_count - 1];
+                while (is_hspace(*cp)) {
+                    cp += 1;
+                }
+                if (cp != text.data + pos) {
+                    continue;
+                }
+                f.doc_lines = arena_push(
+                    job->arena,
+                    f.doc_lines,
+                    &doc_cap,
+                    f.doc_line_count,
+                    sizeof(*f.doc_lines));
+                f.doc_lines[f.doc_line_count++] = f.line_count - 1;
+                continue;
+            }
+            // Leave room for the one-past-the-end entry.
+            f.lines = arena_push(
+                job->arena,
+                f.lines,
+                &line_cap,
+                f.line_count + 1,
+                sizeof(*f.lines));
+            f.lines[f.line_count++] = pos + 1;
+        }
+    }
+#endif
+    f.lines[f.line_count] = (uint32_t)text.size + 1;
+
+    *fp = f;
+    return true;
+}
+
+#if defined(HAVE_SSE2_SCAN) || defined(HAVE_NEON_SCAN)
+static scan_block_fn
+select_scan_block(void)
+{
+#    if defined(HAVE_AVX2_SCAN)
+    if (__builtin_cpu_supports("avx2")) {
+        return scan_block_avx2;
+    }
+#    endif
+#    if defined(HAVE_SSE2_SCAN)
+    return scan_block_sse2;
+#    else
+    return scan_block_neon;
+#    endif
+}
+#endif
+
+#if defined(HAVE_SSE2_SCAN)
+static void
+scan_block_sse2(char const* p, uint64_t* newlines, uint64_t* openers)
+{
+    __m128i const nl = _mm_set1_epi8('\n');
+    __m128i const slash = _mm_set1_epi8('/');
+    __m128i const star = _mm_set1_epi8('*');
+    __m128i const bang = _mm_set1_epi8('!');
+    uint64_t n = 0;
+    uint64_t o = 0;
+    for (int i = 0; i < SCAN_BLOCK_SIZE; i += 16) {
+        __m128i const a = _mm_loadu_si128((__m128i const*)(p + i));
+        __m128i const b = _mm_loadu_si128((__m128i const*)(p + i + 1));
+        __m128i const c = _mm_loadu_si128((__m128i const*)(p + i + 2));
+        __m128i const doc = _mm_and_si128(
+            _mm_and_si128(_mm_cmpeq_epi8(a, slash), _mm_cmpeq_epi8(b, star)),
+            _mm_cmpeq_epi8(c, bang));
+        n |= (uint64_t)(uint16_t)_mm_movemask_epi8(_mm_cmpeq_epi8(a, nl)) << i;
+        o |= (uint64_t)(uint16_t)_mm_movemask_epi8(doc) << i;
+    }
+    *newlines = n;
+    *openers = o;
+}
+#endif
+
+#if defined(HAVE_AVX2_SCAN)
+__attribute__((target("avx2"))) static void
+scan_block_avx2(char const* p, uint64_t* newlines, uint64_t* openers)
+{
+    __m256i const nl = _mm256_set1_epi8('\n');
+    __m256i const slash = _mm256_set1_epi8('/');
+    __m256i const star = _mm256_set1_epi8('*');
+    __m256i const bang = _mm256_set1_epi8('!');
+    uint64_t n = 0;
+    uint64_t o = 0;
+    for (int i = 0; i < SCAN_BLOCK_SIZE; i += 32) {
+        __m256i const a = _mm256_loadu_si256((__m256i const*)(p + i));
+        __m256i const b = _mm256_loadu_si256((__m256i const*)(p + i + 1));
+        __m256i const c = _mm256_loadu_si256((__m256i const*)(p + i + 2));
+        __m256i const doc = _mm256_and_si256(
+            _mm256_and_si256(
+                _mm256_cmpeq_epi8(a, slash), _mm256_cmpeq_epi8(b, star)),
+            _mm256_cmpeq_epi8(c, bang));
+        n |= (uint64_t)(uint32_t)_mm256_movemask_epi8(
+                 _mm256_cmpeq_epi8(a, nl))
+            << i;
+        o |= (uint64_t)(uint32_t)_mm256_movemask_epi8(doc) << i;
+    }
+    *newlines = n;
+    *openers = o;
+}
+#endif
+
+#if defined(HAVE_NEON_SCAN)
+static void
+scan_block_neon(char const* p, uint64_t* newlines, uint64_t* openers)
+{
+    static uint8_t const weights[16] = {
+        1, 2, 4, 8, 16, 32, 64, 128, 1, 2, 4, 8, 16, 32, 64, 128};
+    uint8x16_t const w = vld1q_u8(weights);
+    uint64_t n = 0;
+    uint64_t o = 0;
+    for (int i = 0; i < SCAN_BLOCK_SIZE; i += 16) {
+        uint8_t const* const u = (uint8_t const*)p + i;
+        uint8x16_t const a = vld1q_u8(u);
+        uint8x16_t const doc = vandq_u8(
+            vandq_u8(
+                vceqq_u8(a, vdupq_n_u8('/')),
+                vceqq_u8(vld1q_u8(u + 1), vdupq_n_u8('*'))),
+            vceqq_u8(vld1q_u8(u + 2), vdupq_n_u8('!')));
+        uint8x16_t const nm = vandq_u8(vceqq_u8(a, vdupq_n_u8('\n')), w);
+        uint8x16_t const om = vandq_u8(doc, w);
+        n |= (uint64_t)(vaddv_u8(vget_low_u8(nm))
+                        | vaddv_u8(vget_high_u8(nm)) << 8)
+            << i;
+        o |= (uint64_t)(vaddv_u8(vget_low_u8(om))
+                        | vaddv_u8(vget_high_u8(om)) << 8)
+            << i;
+    }
+    *newlines = n;
+    *openers = o;
+}
+#endif
+
+#if defined(HAVE_SSE2_SCAN) || defined(HAVE_NEON_SCAN)
+static int
+lowest_bit(uint64_t x)
+{
+#    if defined(__GNUC__)
+    return __builtin_ctzll(x);
+#    else
+    int i = 0;
+    while ((x & 1) == 0) {
+        x >>= 1;
+        i += 1;
+    }
+    return i;
+#    endif
+}
+#endif
+
+static char const*
+line_start(struct file const* f, uint32_t line)
+{
+    return f->text + f->lines[line];
+}
+
+static char const*
+line_end(struct file const* f, uint32_t line)
+{
+    return f->text + f->lines[line + 1] - 1;
+}
+
+static uint32_t
+line_of(struct file const* f, uint32_t offset)
+{
+    uint32_t lo = 0;
+    uint32_t hi = f->line_count;
+    while (hi - lo > 1) {
+        uint32_t const mid = lo + (hi - lo) / 2;
+        if (f->lines[mid] <= offset) {
+            lo = mid;
+        }
+        else {
+            hi = mid;
+        }
+    }
+    return lo;
+}
+
+static bool
+is_hspace(int c)
+{
+    return c == '\t' || c == '\r' || c == ' ';
+}
+
+static bool
+is_doc_comment(char const* line, char const* end)
+{
+    while (line != end && is_hspace(*line)) {
+        line += 1;
+    }
+    return end - line >= 3 && strncmp(line, "/*!", 3) == 0;
+}
+
+static char const*
+clean_doc_line(char const* line, char const* end)
+{
+    char const* p = line;
+    while (p != end && is_hspace(*p)) {
+        p++;
+    }
+    if (p != end && *p == '*') {
+        p++;
+        if (p != end && is_hspace(*p)) {
+            p++;
+        }
+    }
+    return p;
+}
+
+static char const*
+find_comment_end(char const* begin, char const* end)
+{
+    if (end - begin < 2) {
+        return NULL;
+    }
+    char const* cp = begin;
+    while ((cp = memchr(cp, '*', (size_t)(end - cp - 1))) != NULL) {
+        if (cp[1] == '/') {
+            return cp;
+        }
+        cp += 1;
+    }
+    return NULL;
+}
+
+#if !defined(CDOC_NO_MAIN)
+static bool
+do_file(struct job* job, FILE* fp)
+{
+    double start = job->options->stats ? clock_seconds() : 0;
+    struct text text;
+    if (!read_text_file(job, fp, &text)) {
+        return false;
+    }
+    job->stats.bytes += text.size;
+    lap(job, &job->stats.read, &start);
+    bool const ok = do_text(job, text);
+    free_text(text);
+    return ok;
+}
+
+static bool
+do_text(struct job* job, struct text text)
+{
+    struct file f;
+    struct doc* docs;
+    size_t doc_count;
+    bool ok = parse_text(job, text, &f, &docs, &doc_count);
+    double start = job->options->stats ? clock_seconds() : 0;
+
+    // PRINT
+    // Docs are counted once for every target, before any is rendered.
+    uint32_t* ordinals = NULL;
+    if (ok) {
+        ordinals = arena_alloc(job->arena, doc_count * sizeof(*ordinals));
+        struct symtab names = {0};
+        symtab_reserve(&names, doc_count);
+        for (size_t i = 0; i < doc_count; ++i) {
+            ordinals[i] = count_doc(&names, &f, &docs[i]);
+        }
+        symtab_free(&names);
+    }
+    for (size_t t = 0; t < job->options->target_count && ok; ++t) {
+        struct output o = {0};
+        o.renderer = job->options->targets[t].renderer;
+        o.sink = &job->outs[t];
+        if (o.renderer->render_file != NULL) {
+            o.renderer->render_file(&o, job->path, &f, docs, doc_count);
+            continue;
+        }
+        if (o.renderer->begin_file != NULL) {
+            o.renderer->begin_file(&o, job->path);
+        }
+        for (size_t i = 0; i < doc_count; ++i) {
+            o.doc_ordinal = ordinals[i];
+            print_doc(&o, &f, &docs[i]);
+        }
+        if (o.renderer->end_file != NULL) {
+            o.renderer->end_file(&o);
+        }
+    }
+    lap(job, &job->stats.render, &start);
+
+    // CLEANUP
+    uint64_t const memory =
+        arena_used(job->arena) + (text.map_size == 0 ? text.size : 0);
+    if (memory > job->stats.memory) {
+        job->stats.memory = memory;
+    }
+    arena_reset(job->arena);
+    return ok;
+}
+#endif
+
+static bool
+parse_text(
+    struct job* job,
+    struct text text,
+    struct file* f,
+    struct doc** docs,
+    size_t* doc_count)
+{
+    double start = job->options->stats ? clock_seconds() : 0;
+    *docs = NULL;
+    *doc_count = 0;
+    if (!text_to_lines(job, text, f)) {
+        return false;
+    }
+    job->stats.lines += f->line_count;
+    lap(job, &job->stats.split, &start);
+    uint32_t line = 0; // current line
+
+    size_t doc_cap = 0;
+    bool ok = true;
+    for (uint32_t i = 0; i < f->doc_line_count && ok; ++i) {
+        // Doc comments within a previously parsed doc or its source are
+        // not the start of a new doc.
+        if (f->doc_lines[i] < line) {
+            continue;
+        }
+        line = f->doc_lines[i];
+        *docs = arena_push(
+            job->arena, *docs, &doc_cap, *doc_count, sizeof(**docs));
+        struct doc* const d = &(*docs)[*doc_count];
+        if (parse_doc(job, f, &line, d)) {
+            *doc_count += !d->skipped;
+        }
+        else {
+            ok = job->options->keep_going;
+        }
+    }
+    job->stats.docs += *doc_count;
+    for (size_t i = 0; i < *doc_count; ++i) {
+        job->stats.sections += (*docs)[i].section_count;
+        job->stats.source_lines += (*docs)[i].source_len;
+    }
+    lap(job, &job->stats.parse, &start);
+    return ok;
+}
+
+struct cdoc_ctx*
+cdoc_ctx_new(void)
+{
+    struct cdoc_ctx* const ctx = xalloc(NULL, sizeof(*ctx));
+    *ctx = (struct cdoc_ctx){0};
+    ctx->options.jobs = 1;
+    ctx->job.options = &ctx->options;
+    ctx->job.path = "-";
+    ctx->job.arena = &ctx->arena;
+    return ctx;
+}
+
+void
+cdoc_ctx_free(struct cdoc_ctx* ctx)
+{
+    if (ctx == NULL) {
+        return;
+    }
+    clear_errors(&ctx->job);
+    arena_free(&ctx->arena);
+    for (size_t i = 0; i < ctx->value_count; ++i) {
+        free(ctx->values[i]);
+    }
+    free(ctx->values);
+    free(ctx->options.only);
+    free(ctx->options.exclude_tags);
+    free(ctx->options.names);
+    free(ctx->options.exclude_names);
+    free(ctx);
+}
+
+void
+cdoc_ctx_keep_going(struct cdoc_ctx* ctx, int enabled)
+{
+    ctx->options.keep_going = enabled != 0;
+}
+
+int
+cdoc_ctx_add_filter(
+    struct cdoc_ctx* ctx, enum cdoc_filter kind, char const* value)
+{
+    struct options* const options = &ctx->options;
+    bool const tags = kind == CDOC_ONLY || kind == CDOC_EXCLUDE_TAG;
+    // add_tag_patterns exits on an empty tag, which a library may not.
+    for (char const* tag = value; tags;) {
+        tag += *tag == '@';
+        if (*tag == '\0' || *tag == ',') {
+            return -1;
+        }
+        tag = strchr(tag, ',');
+        if (tag == NULL) {
+            break;
+        }
+        tag += 1;
+    }
+
+    size_t const len = strlen(value);
+    char* const copy = xalloc(NULL, len + 1);
+    memcpy(copy, value, len + 1);
+    ctx->values = xalloc(
+        ctx->values, (ctx->value_count + 1) * sizeof(*ctx->values));
+    ctx->values[ctx->value_count++] = copy;
+    switch (kind) {
+    case CDOC_ONLY:
+        add_tag_patterns(copy, &options->only, &options->only_count);
+        break;
+    case CDOC_EXCLUDE_TAG:
+        add_tag_patterns(
+            copy, &options->exclude_tags, &options->exclude_tag_count);
+        break;
+    case CDOC_NAME:
+        add_name_pattern(copy, &options->names, &options->name_count);
+        break;
+    case CDOC_EXCLUDE_NAME:
+        add_name_pattern(
+            copy, &options->exclude_names, &options->exclude_name_count);
+        break;
+    }
+    return 0;
+}
+
+int
+cdoc_parse(
+    struct cdoc_ctx* ctx,
+    char const* data,
+    size_t size,
+    cdoc_doc_fn fn,
+    void* user)
+{
+    struct job* const job = &ctx->job;
+    clear_errors(job);
+    if (size != 0 && memchr(data, '\0', size) != NULL) {
+        return job_errorf(job, "Encountered illegal NUL byte") ? 0 : -1;
+    }
+    struct text text = {0};
+    text.data = data;
+    text.size = size;
+    struct file f = {0};
+    struct doc* docs;
+    size_t doc_count;
+    if (parse_text(job, text, &f, &docs, &doc_count)) {
+        for (size_t i = 0; i < doc_count; ++i) {
+            struct cdoc_doc doc;
+            export_doc(job->arena, &f, &docs[i], &doc);
+            fn(user, &doc);
+        }
+    }
+    arena_reset(job->arena);
+    return job->error_count == 0 ? 0 : -1;
+}
+
+size_t
+cdoc_error_count(struct cdoc_ctx const* ctx)
+{
+    return ctx->job.error_count;
+}
+
+char const*
+cdoc_error(struct cdoc_ctx const* ctx, size_t i)
+{
+    return ctx->job.errors[i];
+}
+
+static void
+export_doc(
+    struct arena* arena,
+    struct file const* f,
+    struct doc const* d,
+    struct cdoc_doc* out)
+{
+    *out = (struct cdoc_doc){0};
+    struct cdoc_section* const sections =
+        arena_alloc(arena, d->section_count * sizeof(*sections));
+    for (size_t i = 0; i < d->section_count; ++i) {
+        struct section const* const s = &d->sections[i];
+        struct cdoc_line* const lines =
+            arena_alloc(arena, s->text_len * sizeof(*lines));
+        for (uint32_t j = 0; j < s->text_len; ++j) {
+            char const* const start = line_start(f, s->text_start + j);
+            char const* end = line_end(f, s->text_start + j);
+            if (end > f->text + s->text_end) {
+                end = f->text + s->text_end;
+            }
+            lines[j].text = clean_doc_line(start, end);
+            lines[j].len = (size_t)(end - lines[j].text);
+        }
+        sections[i].tag = f->text + s->tag_start;
+        sections[i].tag_len = s->tag_len;
+        sections[i].name = f->text + s->name_start;
+        sections[i].name_len = s->name_len;
+        sections[i].lines = lines;
+        sections[i].line_count = s->text_len;
+    }
+    if (d->section_count != 0) {
+        out->line = (unsigned long)LINENO(line_of(f, d->sections[0].tag_start));
+    }
+    out->sections = sections;
+    out->section_count = d->section_count;
+
+    if (d->has_source) {
+        struct cdoc_line* const source =
+            arena_alloc(arena, d->source_len * sizeof(*source));
+        for (uint32_t i = 0; i < d->source_len; ++i) {
+            char const* const start = line_start(f, d->source_start + i);
+            char const* const end = line_end(f, d->source_start + i);
+            if (!is_doc_comment(start, end)) {
+                source[out->source_count].text = start;
+                source[out->source_count].len = (size_t)(end - start);
+                out->source_count += 1;
+            }
+        }
+        out->source = source;
+        out->source_elided = d->source_elided;
+    }
+}
+
+static void
+clear_errors(struct job* job)
+{
+    for (size_t i = 0; i < job->error_count; ++i) {
+        free(job->errors[i]);
+    }
+    free(job->errors);
+    job->errors = NULL;
+    job->error_count = 0;
+}
+
+#if !defined(CDOC_NO_MAIN)
+static bool
+do_stream(struct job* job, FILE* fp)
+{
+    size_t const target_count = job->options->target_count;
+    struct output* const outputs =
+        xalloc(NULL, target_count * sizeof(*outputs));
+    for (size_t t = 0; t < target_count; ++t) {
+        outputs[t] = (struct output){0};
+        outputs[t].renderer = job->options->targets[t].renderer;
+        outputs[t].sink = &job->outs[t];
+        if (outputs[t].renderer->begin_file != NULL) {
+            outputs[t].renderer->begin_file(&outputs[t], job->path);
+        }
+    }
+    // The docs of every window are counted together, being of one file.
+    struct symtab names = {0};
+
+    char* buf = NULL; // window of unconsumed text
+    size_t size = 0;
+    size_t cap = 0;
+    size_t const limit = job->options->max_memory;
+    // Bytes that the parse structures of the window are expected to need,
+    // and that they need for each byte of text, from the last window but
+    // no fewer than the text itself.
+    size_t parse_used = 0;
+    double parse_ratio = 1;
+    bool progress = true; // whether the last window consumed any line
+    bool cut = false; // whether the last window was parsed up to a prefix
+    uint32_t first_line = 0;
+    bool eof = false;
+    bool done = false;
+    bool ok = true;
+    double start = job->options->stats ? clock_seconds() : 0;
+    while (ok && !done) {
+        // Read at least as much as the window already holds, so that the
+        // cost of re-parsing a long incomplete doc stays linear.
+        size_t want = size < STREAM_CHUNK_SIZE ? STREAM_CHUNK_SIZE : size;
+        if (limit != 0 && !eof) {
+            // The window shares the limit with its parse structures, and
+            // part of what they leave is kept for those of the text read.
+            // Once nothing is left after a window that consumed no line,
+            // the doc at its start cannot be completed. After one that
+            // did, or that was only parsed up to a prefix, the rest of the
+            // window is parsed again without reading.
+            size_t const used = size + parse_used;
+            size_t const room = used < limit
+                ? (size_t)((double)(limit - used) / (1 + parse_ratio))
+                : 0;
+            if (room == 0 && !progress) {
+                ok = job_errorf(
+                    job,
+                    "[line %d] Doc needs more than the memory limit of %zu "
+                    "bytes",
+                    LINENO(first_line),
+                    limit);
+                break;
+            }
+            want = cut ? 0 : want < room ? want : room;
+        }
+        if (!eof && want != 0) {
+            if (cap - size < want) {
+                // A limited window is held in no more than it may use,
+                // and shrunk to its text once read.
+                size_t const need = size + want;
+                cap = limit == 0 && cap * 2 > need ? cap * 2 : need;
+                buf = xalloc(buf, cap);
+            }
+            ssize_t const n = read(fileno(fp), buf + size, want);
+            if (n < 0) {
+                if (errno == EINTR) {
+                    continue;
+                }
+                ok = job_errorf(job, "Failed to read entire text file");
+                break;
+            }
+            if (memchr(buf + size, '\0', (size_t)n) != NULL) {
+                ok = job_errorf(job, "Encountered illegal NUL byte");
+                break;
+            }
+            size += (size_t)n;
+            eof = n == 0;
+            job->stats.bytes += (uint64_t)n;
+        }
+        if (limit != 0 && cap != size && size != 0) {
+            cap = size;
+            buf = xalloc(buf, cap);
+        }
+        lap(job, &job->stats.read, &start);
+
+        // Only complete lines are parsed until the end of the stream.
+        size_t complete = size;
+        if (!eof) {
+            while (complete != 0 && buf[complete - 1] != '\n') {
+                complete -= 1;
+            }
+            if (complete == 0) {
+                // A single line needs little more than its own bytes.
+                parse_used = 0;
+                progress = false;
+                continue;
+            }
+        }
+
+        // The docs of the window are parsed before any is rendered, so that
+        // each phase is timed once per window. A window too large for the
+        // limit along with its parse structures is parsed again up to half
+        // of its lines, or up to the doc reaching its end, until it fits or
+        // the first doc alone does not.
+        size_t const error_count = job->error_count;
+        size_t const window = complete;
+        bool partial = !eof;
+        struct file f;
+        struct doc* docs;
+        size_t doc_count;
+        uint32_t keep; // first line of the next window
+        uint32_t first_end;
+        bool fits = true;
+        parse_ratio = 1;
+        while (fits) {
+            ok = parse_window(
+                job,
+                buf,
+                complete,
+                partial,
+                first_line,
+                &start,
+                &f,
+                &docs,
+                &doc_count,
+                &keep,
+                &first_end);
+            size_t const used = arena_used(job->arena);
+            double const ratio =
+                complete != 0 ? (double)used / (double)complete : 0;
+            parse_ratio = ratio > parse_ratio ? ratio : parse_ratio;
+            if (!ok || limit == 0 || cap + used <= limit) {
+                break;
+            }
+            // The first complete doc is kept whole and followed by a line,
+            // without which it would reach the end of the window.
+            uint32_t lines = keep < f.line_count ? keep : f.line_count / 2;
+            if (first_end != 0 && lines <= first_end) {
+                lines = first_end + 1;
+            }
+            fits = lines != 0 && lines < f.line_count;
+            complete = fits ? f.lines[lines] : 0;
+            partial = true;
+            while (job->error_count > error_count) {
+                free(job->errors[--job->error_count]);
+            }
+            arena_reset(job->arena);
+        }
+        if (!fits) {
+            ok = job_errorf(
+                job,
+                "[line %d] Doc needs more than the memory limit of %zu bytes",
+                LINENO(first_line),
+                limit);
+            break;
+        }
+        cut = complete != window;
+        for (size_t i = 0; i < doc_count; ++i) {
+            job->stats.docs += 1;
+            job->stats.sections += docs[i].section_count;
+            job->stats.source_lines += docs[i].source_len;
+        }
+        lap(job, &job->stats.parse, &start);
+
+        uint32_t* const ordinals =
+            arena_alloc(job->arena, doc_count * sizeof(*ordinals));
+        for (size_t i = 0; i < doc_count; ++i) {
+            ordinals[i] = count_doc(&names, &f, &docs[i]);
+        }
+        for (size_t t = 0; t < target_count; ++t) {
+            for (size_t i = 0; i < doc_count; ++i) {
+                outputs[t].doc_ordinal = ordinals[i];
+                print_doc(&outputs[t], &f, &docs[i]);
+            }
+            if (ok) {
+                sink_flush(outputs[t].sink);
+            }
+        }
+        lap(job, &job->stats.render, &start);
+        job->stats.lines += keep;
+        size_t const used = arena_used(job->arena);
+        if (cap + used > job->stats.memory) {
+            job->stats.memory = cap + used;
+        }
+
+        done = !partial;
+        progress = keep != 0;
+        if (ok && partial) {
+            // The lines kept are expected to need their share of the parse
+            // structures of the window, which is all of them unless the
+            // window consumed a line.
+            size_t const consumed = f.lines[keep];
+            parse_used = (size_t)((double)used
+                * (double)(complete - consumed) / (double)complete);
+            memmove(buf, buf + consumed, size - consumed);
+            size -= consumed;
+            first_line += keep;
+        }
+        arena_reset(job->arena);
+    }
+    arena_reset(job->arena);
+
+    for (size_t t = 0; t < target_count && ok; ++t) {
+        if (outputs[t].renderer->end_file != NULL) {
+            outputs[t].renderer->end_file(&outputs[t]);
+        }
+    }
+    symtab_free(&names);
+    free(buf);
+    free(outputs);
+    return ok;
+}
+
+static bool
+parse_window(
+    struct job* job,
+    char const* buf,
+    size_t size,
+    bool partial,
+    uint32_t first_line,
+    double* start,
+    struct file* f,
+    struct doc** docs,
+    size_t* doc_count,
+    uint32_t* keep,
+    uint32_t* first_end)
+{
+    *docs = NULL;
+    *doc_count = 0;
+    *keep = 0;
+    *first_end = 0;
+    struct text text = {0};
+    text.data = buf;
+    text.size = size;
+    if (!text_to_lines(job, text, f)) {
+        return false;
+    }
+    if (partial) {
+        // Drop the empty line following the final newline.
+        f->line_count -= 1;
+    }
+    f->first_line = first_line;
+    f->partial = partial;
+    lap(job, &job->stats.split, start);
+
+    uint32_t line = 0;
+    size_t doc_cap = 0;
+    bool ok = true;
+    *keep = f->line_count;
+    for (uint32_t i = 0; i < f->doc_line_count && ok; ++i) {
+        if (f->doc_lines[i] < line || f->doc_lines[i] >= f->line_count) {
+            continue;
+        }
+        uint32_t const doc_start = f->doc_lines[i];
+        line = doc_start;
+        *docs = arena_push(
+            job->arena, *docs, &doc_cap, *doc_count, sizeof(**docs));
+        struct doc* const d = &(*docs)[*doc_count];
+        size_t const error_count = job->error_count;
+        bool const parsed = parse_doc(job, f, &line, d);
+        if (line >= f->line_count && partial) {
+            // The rest of the doc may change how it parses, so it is
+            // parsed again along with any error it produced.
+            while (job->error_count > error_count) {
+                free(job->errors[--job->error_count]);
+            }
+            *keep = doc_start;
+            break;
+        }
+        if (*first_end == 0) {
+            *first_end = line;
+        }
+        if (!parsed) {
+            ok = job->options->keep_going;
+            continue;
+        }
+        *doc_count += !d->skipped;
+    }
+    return ok;
+}
+
+static bool
+do_cached_file(struct job* job, FILE* fp)
+{
+    struct stat st;
+    if (fstat(fileno(fp), &st) != 0) {
+        return do_file(job, fp);
+    }
+    size_t const target_count = job->options->target_count;
+    uint64_t const key = cache_key(job);
+    size_t const path_size = strlen(job->options->cache_dir) + 18;
+    char* const path = xalloc(NULL, path_size);
+    snprintf(path, path_size, "%s/%016" PRIx64, job->options->cache_dir, key);
+
+    struct cache_header header = {0};
+    char* entry = NULL;
+    struct iovec* cached = read_cache_entry(job, path, key, &header, &entry);
+    bool const same_stat = cached != NULL && header.mtime_sec != 0
+        && header.size == (uint64_t)st.st_size
+        && header.dev == (uint64_t)st.st_dev
+        && header.ino == (uint64_t)st.st_ino
+        && header.mtime_sec == (int64_t)st.st_mtim.tv_sec
+        && header.mtime_nsec == (int64_t)st.st_mtim.tv_nsec;
+
+    bool ok = true;
+    struct text text = {0};
+    bool have_text = false;
+    uint64_t content_hash = header.content_hash;
+    if (!same_stat) {
+        double start = job->options->stats ? clock_seconds() : 0;
+        if (!read_text_file(job, fp, &text)) {
+            ok = false;
+            goto cleanup;
+        }
+        have_text = true;
+        content_hash = hash64(text.data, text.size, 0);
+        job->stats.bytes += text.size;
+        lap(job, &job->stats.read, &start);
+    }
+
+    if (cached != NULL && header.content_hash == content_hash) {
+        for (size_t t = 0; t < target_count; ++t) {
+            sink_write(&job->outs[t], cached[t].iov_base, cached[t].iov_len);
+        }
+        if (!same_stat) {
+            // Touched but unchanged; restore the stat fast path.
+            set_cache_stat(&header, &st);
+            write_cache_entry(job, path, &header, cached);
+        }
+    }
+    else {
+        // Render into memory so that the output can also be stored.
+        struct sink* const outs = job->outs;
+        struct sink* const bufs = xalloc(NULL, target_count * sizeof(*bufs));
+        for (size_t t = 0; t < target_count; ++t) {
+            sink_init_memory(&bufs[t]);
+        }
+        job->outs = bufs;
+        ok = do_text(job, text);
+        job->outs = outs;
+
+        if (ok) {
+            struct iovec* const outputs =
+                xalloc(NULL, target_count * sizeof(*outputs));
+            for (size_t t = 0; t < target_count; ++t) {
+                sink_write(&outs[t], bufs[t].buf, bufs[t].size);
+                outputs[t].iov_base = bufs[t].buf;
+                outputs[t].iov_len = bufs[t].size;
+            }
+            // Files with errors are not cached so that their errors are
+            // reported again by the next run.
+            if (job->error_count == 0) {
+                header = (struct cache_header){0};
+                header.key = key;
+                header.content_hash = content_hash;
+                set_cache_stat(&header, &st);
+                write_cache_entry(job, path, &header, outputs);
+            }
+            free(outputs);
+        }
+        for (size_t t = 0; t < target_count; ++t) {
+            sink_free(&bufs[t]);
+        }
+        free(bufs);
+    }
+
+cleanup:
+    if (have_text) {
+        free_text(text);
+    }
+    free(cached);
+    free(entry);
+    free(path);
+    return ok;
+}
+
+static uint64_t
+cache_key(struct job const* job)
+{
+    uint64_t key = hash64(VERSION, sizeof(VERSION), 0);
+    for (size_t t = 0; t < job->options->target_count; ++t) {
+        char const* const name = job->options->targets[t].renderer->name;
+        key = hash64(name, strlen(name) + 1, key);
+    }
+    if (job->options->highlight) {
+        key = hash64("h", 1, key);
+    }
+    // Filters change which docs are rendered. Each pattern is hashed with
+    // its NUL after a marker of its list, so that neither equal patterns in
+    // different lists nor different splits of the same bytes collide.
+    struct options const* const options = job->options;
+    for (size_t i = 0; i < options->only_count; ++i) {
+        key = hash64("o", 1, key);
+        key = hash64(options->only[i].str, options->only[i].len + 1, key);
+    }
+    for (size_t i = 0; i < options->exclude_tag_count; ++i) {
+        struct tag_pattern const* const p = &options->exclude_tags[i];
+        key = hash64("x", 1, key);
+        key = hash64(p->str, p->len + 1, key);
+    }
+    for (size_t i = 0; i < options->name_count; ++i) {
+        char const* const glob = options->names[i];
+        key = hash64("n", 1, key);
+        key = hash64(glob, strlen(glob) + 1, key);
+    }
+    for (size_t i = 0; i < options->exclude_name_count; ++i) {
+        char const* const glob = options->exclude_names[i];
+        key = hash64("X", 1, key);
+        key = hash64(glob, strlen(glob) + 1, key);
+    }
+    return hash64(job->path, strlen(job->path), key);
+}
+
+static struct iovec*
+read_cache_entry(
+    struct job const* job,
+    char const* path,
+    uint64_t key,
+    struct cache_header* header,
+    char** bufp)
+{
+    int const fd = open(path, O_RDONLY);
+    if (fd < 0) {
+        return NULL;
+    }
+    struct stat st;
+    if (fstat(fd, &st) != 0 || (size_t)st.st_size < sizeof(*header)) {
+        close(fd);
+        return NULL;
+    }
+    size_t const size = (size_t)st.st_size;
+    char* const buf = xalloc(NULL, size);
+    size_t got = 0;
+    while (got < size) {
+        ssize_t const n = read(fd, buf + got, size - got);
+        if (n < 0 && errno == EINTR) {
+            continue;
+        }
+        if (n <= 0) {
+            break;
+        }
+        got += (size_t)n;
+    }
+    close(fd);
+
+    size_t const count = job->options->target_count;
+    memcpy(header, buf, sizeof(*header));
+    if (got != size || memcmp(header->magic, "cdoc2", 6) != 0
+        || header->key != key || header->output_count != count
+        || (size - sizeof(*header)) / sizeof(uint64_t) < count) {
+        free(buf);
+        return NULL;
+    }
+
+    struct iovec* const outputs = xalloc(NULL, count * sizeof(*outputs));
+    size_t offset = sizeof(*header) + count * sizeof(uint64_t);
+    for (size_t t = 0; t < count; ++t) {
+        uint64_t const len = read_u64(
+            (unsigned char const*)buf + sizeof(*header) + t * sizeof(len));
+        if (len > size - offset) {
+            free(outputs);
+            free(buf);
+            return NULL;
+        }
+        outputs[t].iov_base = buf + offset;
+        outputs[t].iov_len = (size_t)len;
+        offset += (size_t)len;
+    }
+    if (offset != size) {
+        free(outputs);
+        free(buf);
+        return NULL;
+    }
+    *bufp = buf;
+    return outputs;
+}
+
+static void
+write_cache_entry(
+    struct job const* job,
+    char const* path,
+    struct cache_header const* header,
+    struct iovec const* outputs)
+{
+    size_t const tmp_size = strlen(job->options->cache_dir) + 16;
+    char* const tmp = xalloc(NULL, tmp_size);
+    snprintf(tmp, tmp_size, "%s/.tmp.XXXXXX", job->options->cache_dir);
+    int const fd = mkstemp(tmp);
+    if (fd < 0) {
+        free(tmp);
+        return;
+    }
+
+    size_t const count = job->options->target_count;
+    struct cache_header h = *header;
+    memcpy(h.magic, "cdoc2", 6);
+    h.output_count = count;
+
+    struct sink s;
+    sink_init_fd(&s, fd);
+    sink_write(&s, (char const*)&h, sizeof(h));
+    for (size_t t = 0; t < count; ++t) {
+        uint64_t const len = outputs[t].iov_len;
+        sink_write(&s, (char const*)&len, sizeof(len));
+    }
+    for (size_t t = 0; t < count; ++t) {
+        sink_write(&s, outputs[t].iov_base, outputs[t].iov_len);
+    }
+    sink_flush(&s);
+    if (close(fd) != 0 || s.error != 0 || rename(tmp, path) != 0) {
+        unlink(tmp);
+    }
+    sink_free(&s);
+    free(tmp);
+}
+
+static void
+set_cache_stat(struct cache_header* header, struct stat const* st)
+{
+    header->size = (uint64_t)st->st_size;
+    header->dev = (uint64_t)st->st_dev;
+    header->ino = (uint64_t)st->st_ino;
+    header->mtime_sec = (int64_t)st->st_mtim.tv_sec;
+    header->mtime_nsec = (int64_t)st->st_mtim.tv_nsec;
+    // A file modified within the last second may be modified again without
+    // its modification time changing, so it must be hashed next time.
+    if (st->st_mtim.tv_sec >= time(NULL) - 1) {
+        header->mtime_sec = 0;
+    }
+}
+
+static uint64_t
+hash64(void const* data, size_t size, uint64_t seed)
+{
+    unsigned char const* p = data;
+    unsigned char const* const end = p + size;
+    uint64_t h;
+
+    if (size >= 32) {
+        uint64_t v1 = seed + HASH64_PRIME1 + HASH64_PRIME2;
+        uint64_t v2 = seed + HASH64_PRIME2;
+        uint64_t v3 = seed;
+        uint64_t v4 = seed - HASH64_PRIME1;
+        for (; end - p >= 32; p += 32) {
+            v1 = hash64_round(v1, read_u64(p));
+            v2 = hash64_round(v2, read_u64(p + 8));
+            v3 = hash64_round(v3, read_u64(p + 16));
+            v4 = hash64_round(v4, read_u64(p + 24));
+        }
+        h = ROTL64(v1, 1) + ROTL64(v2, 7) + ROTL64(v3, 12) + ROTL64(v4, 18);
+        uint64_t const v[4] = {v1, v2, v3, v4};
+        for (int i = 0; i < 4; ++i) {
+            h ^= hash64_round(0, v[i]);
+            h = h * HASH64_PRIME1 + HASH64_PRIME4;
+        }
+    }
+    else {
+        h = seed + HASH64_PRIME5;
+    }
+    h += (uint64_t)size;
+
+    for (; end - p >= 8; p += 8) {
+        h ^= hash64_round(0, read_u64(p));
+        h = ROTL64(h, 27) * HASH64_PRIME1 + HASH64_PRIME4;
+    }
+    if (end - p >= 4) {
+        uint32_t k;
+        memcpy(&k, p, sizeof(k));
+        h ^= (uint64_t)k * HASH64_PRIME1;
+        h = ROTL64(h, 23) * HASH64_PRIME2 + HASH64_PRIME3;
+        p += 4;
+    }
+    for (; p != end; ++p) {
+        h ^= (uint64_t)*p * HASH64_PRIME5;
+        h = ROTL64(h, 11) * HASH64_PRIME1;
+    }
+
+    h ^= h >> 33;
+    h *= HASH64_PRIME2;
+    h ^= h >> 29;
+    h *= HASH64_PRIME3;
+    h ^= h >> 32;
+    return h;
+}
+
+static uint64_t
+hash64_round(uint64_t acc, uint64_t input)
+{
+    acc += input * HASH64_PRIME2;
+    acc = ROTL64(acc, 31);
+    return acc * HASH64_PRIME1;
+}
+
+static uint64_t
+read_u64(unsigned char const* p)
+{
+    uint64_t x;
+    memcpy(&x, p, sizeof(x));
+    return x;
+}
+
+static void
+run_watch(struct options const* options)
+{
+    mode_t const mask = umask(0);
+    umask(mask);
+
+    // Start watching before the first scan so that no change made during
+    // the scan is missed.
+    int fd = -1;
+#if defined(__linux__)
+    fd = inotify_init1(IN_CLOEXEC);
+    uint32_t const events = IN_ATTRIB | IN_CLOSE_WRITE | IN_CREATE
+                          | IN_DELETE | IN_MODIFY | IN_MOVED_FROM
+                          | IN_MOVED_TO;
+    if (fd >= 0 && inotify_add_watch(fd, options->watch_dir, events) < 0) {
+        close(fd);
+        fd = -1;
+    }
+#endif
+
+    struct watch_file* files = NULL;
+    size_t count = 0;
+    struct arena arena = {0};
+    bool first = true;
+    for (;;) {
+        if (scan_watch_dir(options, &files, &count) || first) {
+            struct stats totals = {0};
+            for (size_t i = 0; i < count; ++i) {
+                if (files[i].outputs == NULL) {
+                    render_watch_file(options, &files[i], &arena, &totals);
+                }
+            }
+            struct iovec* const parts = xalloc(NULL, count * sizeof(*parts));
+            for (size_t t = 0; t < options->target_count; ++t) {
+                for (size_t i = 0; i < count; ++i) {
+                    parts[i].iov_base = files[i].outputs[t].buf;
+                    parts[i].iov_len = files[i].outputs[t].size;
+                }
+                char const* path = options->targets[t].path;
+                if (path != NULL) {
+                    int const error =
+                        replace_file(path, parts, count, 0666 & ~mask);
+                    if (error != 0) {
+                        errorf("Failed to write %s: %s", path, strerror(error));
+                    }
+                    continue;
+                }
+                // The symbols of every file are indexed as a whole.
+                struct sink symbols;
+                struct sink index;
+                sink_init_memory(&symbols);
+                sink_init_memory(&index);
+                for (size_t i = 0; i < count; ++i) {
+                    sink_write(&symbols, parts[i].iov_base, parts[i].iov_len);
+                }
+                render_index(options, symbols.buf, symbols.size, &index);
+                struct iovec whole;
+                whole.iov_base = index.buf;
+                whole.iov_len = index.size;
+                path = options->index_path;
+                int const error = replace_file(path, &whole, 1, 0666 & ~mask);
+                if (error != 0) {
+                    errorf("Failed to write %s: %s", path, strerror(error));
+                }
+                sink_free(&symbols);
+                sink_free(&index);
+            }
+            free(parts);
+            if (options->stats) {
+                totals.peak_rss = peak_rss();
+                print_stats("total", &totals);
+            }
+            first = false;
+        }
+        wait_for_change(fd);
+    }
+}
+
+static bool
+scan_watch_dir(
+    struct options const* options, struct watch_file** files, size_t* count)
+{
+    DIR* const dir = opendir(options->watch_dir);
+    if (dir == NULL) {
+        errorf("%s: %s", options->watch_dir, strerror(errno));
+    }
+    size_t const dir_len = strlen(options->watch_dir);
+    bool const has_slash = options->watch_dir[dir_len - 1] == '/';
+
+    struct watch_file* list = NULL;
+    size_t list_count = 0;
+    size_t list_cap = 0;
+    struct dirent* entry;
+    while ((errno = 0, entry = readdir(dir)) != NULL) {
+        if (!is_watched_name(entry->d_name)) {
+            continue;
+        }
+        size_t const size = dir_len + strlen(entry->d_name) + 2;
+        char* const path = xalloc(NULL, size);
+        snprintf(
+            path,
+            size,
+            "%s%s%s",
+            options->watch_dir,
+            has_slash ? "" : "/",
+            entry->d_name);
+        struct stat st;
+        // A file removed since it was listed is picked up by the next scan.
+        if (stat(path, &st) != 0 || !S_ISREG(st.st_mode)) {
+            free(path);
+            continue;
+        }
+        if (list_count == list_cap) {
+            list_cap = list_cap == 0 ? 16 : list_cap * 2;
+            list = xalloc(list, list_cap * sizeof(*list));
+        }
+        list[list_count] = (struct watch_file){0};
+        list[list_count].path = path;
+        list[list_count].st = st;
+        // As with the cache, a file modified within the last second may be
+        // modified again without its modification time changing.
+        list[list_count].recent = st.st_mtim.tv_sec >= time(NULL) - 1;
+        list_count += 1;
+    }
+    if (errno != 0) {
+        errorf("%s: %s", options->watch_dir, strerror(errno));
+    }
+    closedir(dir);
+    if (list_count > 1) {
+        qsort(list, list_count, sizeof(*list), compare_watch_files);
+    }
+
+    // Both lists are sorted by path, so the files of the previous scan are
+    // matched in a single merge pass.
+    struct watch_file* const old = *files;
+    size_t const old_count = *count;
+    bool changed = list_count != old_count;
+    size_t j = 0;
+    for (size_t i = 0; i < list_count; ++i) {
+        struct watch_file* const file = &list[i];
+        while (j < old_count && strcmp(old[j].path, file->path) < 0) {
+            j += 1;
+        }
+        if (j == old_count || strcmp(old[j].path, file->path) != 0) {
+            changed = true;
+            continue;
+        }
+        struct stat const* const a = &old[j].st;
+        struct stat const* const b = &file->st;
+        bool const same = !old[j].recent && a->st_size == b->st_size
+                       && a->st_dev == b->st_dev && a->st_ino == b->st_ino
+                       && a->st_mtim.tv_sec == b->st_mtim.tv_sec
+                       && a->st_mtim.tv_nsec == b->st_mtim.tv_nsec;
+        if (same) {
+            file->outputs = old[j].outputs;
+            old[j].outputs = NULL;
+        }
+        else {
+            changed = true;
+        }
+    }
+
+    for (size_t i = 0; i < old_count; ++i) {
+        if (old[i].outputs != NULL) {
+            for (size_t t = 0; t < options->target_count; ++t) {
+                sink_free(&old[i].outputs[t]);
+            }
+            free(old[i].outputs);
+        }
+        free(old[i].path);
+    }
+    free(old);
+    *files = list;
+    *count = list_count;
+    return changed;
+}
+
+static bool
+is_watched_name(char const* name)
+{
+    size_t const len = strlen(name);
+    return name[0] != '.' && len > 2 && name[len - 2] == '.'
+        && (name[len - 1] == 'c' || name[len - 1] == 'h');
+}
+
+static int
+compare_watch_files(void const* lhs, void const* rhs)
+{
+    struct watch_file const* const a = lhs;
+    struct watch_file const* const b = rhs;
+    return strcmp(a->path, b->path);
+}
+
+static void
+render_watch_file(
+    struct options const* options,
+    struct watch_file* file,
+    struct arena* arena,
+    struct stats* totals)
+{
+    size_t const target_count = options->target_count;
+    file->outputs = xalloc(NULL, target_count * sizeof(*file->outputs));
+    for (size_t t = 0; t < target_count; ++t) {
+        sink_init_memory(&file->outputs[t]);
+    }
+
+    struct job job = {0};
+    job.options = options;
+    job.path = file->path;
+    job.outs = file->outputs;
+    job.arena = arena;
+    run_job(&job);
+    finish_job(&job, file->outputs, totals);
+
+    // The outputs are held until the file changes again, so the unused
+    // capacity of each buffer is returned.
+    for (size_t t = 0; t < target_count; ++t) {
+        struct sink* const s = &file->outputs[t];
+        s->cap = s->size != 0 ? s->size : 1;
+        s->buf = xalloc(s->buf, s->cap);
+    }
+}
+
+static int
+replace_file(
+    char const* path, struct iovec const* parts, size_t count, mode_t mode)
+{
+    size_t const tmp_size = strlen(path) + 8;
+    char* const tmp = xalloc(NULL, tmp_size);
+    snprintf(tmp, tmp_size, "%s.XXXXXX", path);
+    int const fd = mkstemp(tmp);
+    if (fd < 0) {
+        int const error = errno;
+        free(tmp);
+        return error;
+    }
+
+    struct sink s;
+    sink_init_fd(&s, fd);
+    for (size_t i = 0; i < count; ++i) {
+        sink_write(&s, parts[i].iov_base, parts[i].iov_len);
+    }
+    sink_flush(&s);
+    if (fchmod(fd, mode) != 0 && s.error == 0) {
+        s.error = errno;
+    }
+    if (close(fd) != 0 && s.error == 0) {
+        s.error = errno;
+    }
+    if (s.error == 0 && rename(tmp, path) != 0) {
+        s.error = errno;
+    }
+    if (s.error != 0) {
+        unlink(tmp);
+    }
+    int const error = s.error;
+    sink_free(&s);
+    free(tmp);
+    return error;
+}
+
+static void
+wait_for_change(int fd)
+{
+    if (fd < 0) {
+        struct timespec const interval = {WATCH_POLL_INTERVAL, 0};
+        nanosleep(&interval, NULL);
+        return;
+    }
+
+    // Wait for a first notification, then consume notifications until none
+    // has arrived for WATCH_SETTLE_MS. The directory is rescanned as a
+    // whole, so the notifications themselves are discarded.
+    struct pollfd pfd = {0};
+    pfd.fd = fd;
+    pfd.events = POLLIN;
+    int timeout = -1;
+    for (;;) {
+        int const ready = poll(&pfd, 1, timeout);
+        if (ready == 0) {
+            return;
+        }
+        if (ready < 0) {
+            if (errno != EINTR) {
+                errorf("Failed to wait for changes: %s", strerror(errno));
+            }
+            continue;
+        }
+        char buf[4096];
+        if (read(fd, buf, sizeof(buf)) < 0 && errno != EINTR) {
+            errorf("Failed to read changes: %s", strerror(errno));
+        }
+        timeout = WATCH_SETTLE_MS;
+    }
+}
+#endif
+
+// clang-format off
+static unsigned char const lex_classes[256] = {
+    ['/'] = LEX_C_SLASH,
+    ['*'] = LEX_C_STAR,
+    ['\\'] = LEX_C_BACKSLASH,
+    ['"'] = LEX_C_DQUOTE,
+    ['\''] = LEX_C_SQUOTE,
+    ['{'] = LEX_C_LBRACE,
+    ['}'] = LEX_C_RBRACE,
+    [';'] = LEX_C_SEMICOLON,
+    ['\n'] = LEX_C_NEWLINE,
+};
+
+#define T(state, token) {LEX_##state, LEX_##token}
+// Columns: other, '/', '*', '\\', '"', '\'', '{', '}', ';', newline.
+static struct lex_transition const
+lex_table[LEX_STATE_COUNT][LEX_CLASS_COUNT] = {
+    [LEX_CODE] = {
+        T(CODE, NONE), T(SLASH, NONE), T(CODE, NONE),
+        T(CODE_ESCAPE, NONE), T(STRING, NONE), T(CHAR, NONE),
+        T(CODE, LBRACE), T(CODE, RBRACE), T(CODE, SEMICOLON),
+        T(CODE, EOL),
+    },
+    [LEX_SLASH] = {
+        T(CODE, NONE), T(LINE_COMMENT, NONE), T(BLOCK_COMMENT, NONE),
+        T(CODE_ESCAPE, NONE), T(STRING, NONE), T(CHAR, NONE),
+        T(CODE, LBRACE), T(CODE, RBRACE), T(CODE, SEMICOLON),
+        T(CODE, EOL),
+    },
+    [LEX_CODE_ESCAPE] = {
+        T(CODE, NONE), T(SLASH, NONE), T(CODE, NONE),
+        T(CODE_ESCAPE, NONE), T(STRING, NONE), T(CHAR, NONE),
+        T(CODE, LBRACE), T(CODE, RBRACE), T(CODE, SEMICOLON),
+        T(CODE, NONE),
+    },
+    [LEX_LINE_COMMENT] = {
+        T(LINE_COMMENT, NONE), T(LINE_COMMENT, NONE), T(LINE_COMMENT, NONE),
+        T(LINE_COMMENT_ESCAPE, NONE), T(LINE_COMMENT, NONE),
+        T(LINE_COMMENT, NONE), T(LINE_COMMENT, NONE), T(LINE_COMMENT, NONE),
+        T(LINE_COMMENT, NONE), T(CODE, EOL),
+    },
+    [LEX_LINE_COMMENT_ESCAPE] = {
+        T(LINE_COMMENT, NONE), T(LINE_COMMENT, NONE), T(LINE_COMMENT, NONE),
+        T(LINE_COMMENT_ESCAPE, NONE), T(LINE_COMMENT, NONE),
+        T(LINE_COMMENT, NONE), T(LINE_COMMENT, NONE), T(LINE_COMMENT, NONE),
+        T(LINE_COMMENT, NONE), T(LINE_COMMENT, NONE),
+    },
+    [LEX_BLOCK_COMMENT] = {
+        T(BLOCK_COMMENT, NONE), T(BLOCK_COMMENT, NONE), T(BLOCK_STAR, NONE),
+        T(BLOCK_COMMENT, NONE), T(BLOCK_COMMENT, NONE),
+        T(BLOCK_COMMENT, NONE), T(BLOCK_COMMENT, NONE),
+        T(BLOCK_COMMENT, NONE), T(BLOCK_COMMENT, NONE),
+        T(BLOCK_COMMENT, NONE),
+    },
+    [LEX_BLOCK_STAR] = {
+        T(BLOCK_COMMENT, NONE), T(CODE, NONE), T(BLOCK_STAR, NONE),
+        T(BLOCK_COMMENT, NONE), T(BLOCK_COMMENT, NONE),
+        T(BLOCK_COMMENT, NONE), T(BLOCK_COMMENT, NONE),
+        T(BLOCK_COMMENT, NONE), T(BLOCK_COMMENT, NONE),
+        T(BLOCK_COMMENT, NONE),
+    },
+    // An unterminated literal ends at the end of its line.
+    [LEX_STRING] = {
+        T(STRING, NONE), T(STRING, NONE), T(STRING, NONE),
+        T(STRING_ESCAPE, NONE), T(CODE, NONE), T(STRING, NONE),
+        T(STRING, NONE), T(STRING, NONE), T(STRING, NONE),
+        T(CODE, EOL),
+    },
+    [LEX_STRING_ESCAPE] = {
+        T(STRING, NONE), T(STRING, NONE), T(STRING, NONE),
+        T(STRING, NONE), T(STRING, NONE), T(STRING, NONE),
+        T(STRING, NONE), T(STRING, NONE), T(STRING, NONE),
+        T(STRING, NONE),
+    },
+    [LEX_CHAR] = {
+        T(CHAR, NONE), T(CHAR, NONE), T(CHAR, NONE),
+        T(CHAR_ESCAPE, NONE), T(CHAR, NONE), T(CODE, NONE),
+        T(CHAR, NONE), T(CHAR, NONE), T(CHAR, NONE),
+        T(CODE, EOL),
+    },
+    [LEX_CHAR_ESCAPE] = {
+        T(CHAR, NONE), T(CHAR, NONE), T(CHAR, NONE),
+        T(CHAR, NONE), T(CHAR, NONE), T(CHAR, NONE),
+        T(CHAR, NONE), T(CHAR, NONE), T(CHAR, NONE),
+        T(CHAR, NONE),
+    },
+};
+#undef T
+// clang-format on
+
+static void
+lex_line(struct lexer* lx, char const* start, char const* end)
+{
+    lx->cp = start;
+    lx->end = end;
+    lx->eol = false;
+}
+
+static enum lex_token
+lex_next(struct lexer* lx)
+{
+    unsigned state = lx->state;
+    char const* cp = lx->cp;
+    char const* const end = lx->end;
+    while (cp != end) {
+        // Runs of characters that neither change the state nor produce a
+        // token are skipped without the transition table, which would make
+        // each character wait on the state computed for the previous one.
+        if (state == LEX_CODE) {
+            cp = lex_skip_code(cp, end);
+            if (cp == end) {
+                break;
+            }
+        }
+        else if (state == LEX_BLOCK_COMMENT) {
+            char const* const star = memchr(cp, '*', (size_t)(end - cp));
+            if (star == NULL) {
+                cp = end;
+                break;
+            }
+            cp = star;
+        }
+        else if (state == LEX_LINE_COMMENT) {
+            cp = end - 1; // Only a '\\' ending the line has an effect.
+        }
+        struct lex_transition const t =
+            lex_table[state][lex_classes[(unsigned char)*cp++]];
+        state = t.state;
+        if (t.token != LEX_NONE) {
+            lx->state = (unsigned char)state;
+            lx->cp = cp;
+            return (enum lex_token)t.token;
+        }
+    }
+    lx->cp = cp;
+    if (lx->eol) {
+        lx->state = (unsigned char)state;
+        return LEX_NONE;
+    }
+    // The newline is not part of the line, or absent at the end of the
+    // text, so it is lexed on its own.
+    struct lex_transition const t = lex_table[state][LEX_C_NEWLINE];
+    lx->state = t.state;
+    lx->eol = true;
+    return (enum lex_token)t.token;
+}
+
+static char const*
+lex_skip_code(char const* cp, char const* end)
+{
+#if defined(HAVE_SSE2_SCAN)
+    for (; end - cp >= 16; cp += 16) {
+        __m128i const a = _mm_loadu_si128((__m128i const*)cp);
+        __m128i const m = _mm_or_si128(
+            _mm_or_si128(
+                _mm_or_si128(
+                    _mm_cmpeq_epi8(a, _mm_set1_epi8('/')),
+                    _mm_cmpeq_epi8(a, _mm_set1_epi8('\\'))),
+                _mm_or_si128(
+                    _mm_cmpeq_epi8(a, _mm_set1_epi8('"')),
+                    _mm_cmpeq_epi8(a, _mm_set1_epi8('\'')))),
+            _mm_or_si128(
+                _mm_or_si128(
+                    _mm_cmpeq_epi8(a, _mm_set1_epi8('{')),
+                    _mm_cmpeq_epi8(a, _mm_set1_epi8('}'))),
+                _mm_cmpeq_epi8(a, _mm_set1_epi8(';'))));
+        int const mask = _mm_movemask_epi8(m);
+        if (mask != 0) {
+            return cp + lowest_bit((uint64_t)mask);
+        }
+    }
+#elif defined(HAVE_NEON_SCAN)
+    for (; end - cp >= 16; cp += 16) {
+        uint8x16_t const a = vld1q_u8((uint8_t const*)cp);
+        uint8x16_t const m = vorrq_u8(
+            vorrq_u8(
+                vorrq_u8(
+                    vceqq_u8(a, vdupq_n_u8('/')),
+                    vceqq_u8(a, vdupq_n_u8('\\'))),
+                vorrq_u8(
+                    vceqq_u8(a, vdupq_n_u8('"')),
+                    vceqq_u8(a, vdupq_n_u8('\'')))),
+            vorrq_u8(
+                vorrq_u8(
+                    vceqq_u8(a, vdupq_n_u8('{')),
+                    vceqq_u8(a, vdupq_n_u8('}'))),
+                vceqq_u8(a, vdupq_n_u8(';'))));
+        // Narrow each byte of the mask to four bits of a 64-bit value.
+        uint64_t const mask = vget_lane_u64(
+            vreinterpret_u64_u8(vshrn_n_u16(vreinterpretq_u16_u8(m), 4)), 0);
+        if (mask != 0) {
+            return cp + lowest_bit(mask) / 4;
+        }
+    }
+#endif
+    while (cp != end && lex_classes[(unsigned char)*cp] == LEX_OTHER) {
+        cp += 1;
+    }
+    return cp;
+}
+
+static char const*
+lex_skip_plain(char const* cp, char const* end)
+{
+#if defined(HAVE_SSE2_SCAN)
+    for (; end - cp >= 16; cp += 16) {
+        __m128i const a = _mm_loadu_si128((__m128i const*)cp);
+        __m128i const m = _mm_or_si128(
+            _mm_cmpeq_epi8(a, _mm_set1_epi8('/')),
+            _mm_or_si128(
+                _mm_cmpeq_epi8(a, _mm_set1_epi8('"')),
+                _mm_cmpeq_epi8(a, _mm_set1_epi8('\''))));
+        int const mask = _mm_movemask_epi8(m);
+        if (mask != 0) {
+            return cp + lowest_bit((uint64_t)mask);
+        }
+    }
+#elif defined(HAVE_NEON_SCAN)
+    for (; end - cp >= 16; cp += 16) {
+        uint8x16_t const a = vld1q_u8((uint8_t const*)cp);
+        uint8x16_t const m = vorrq_u8(
+            vceqq_u8(a, vdupq_n_u8('/')),
+            vorrq_u8(
+                vceqq_u8(a, vdupq_n_u8('"')), vceqq_u8(a, vdupq_n_u8('\''))));
+        // Narrow each byte of the mask to four bits of a 64-bit value.
+        uint64_t const mask = vget_lane_u64(
+            vreinterpret_u64_u8(vshrn_n_u16(vreinterpretq_u16_u8(m), 4)), 0);
+        if (mask != 0) {
+            return cp + lowest_bit(mask) / 4;
+        }
+    }
+#endif
+    while (cp != end && *cp != '/' && *cp != '"' && *cp != '\'') {
+        cp += 1;
+    }
+    return cp;
+}
+
+static void
+parse_struct_source(struct file const* f, uint32_t* linep, struct doc* d)
+{
+    uint32_t const limit = source_limit(f, d);
+    struct lexer lx = {0};
+    bool parsed = false; // Are we finished parsing the source?
+    int brackets = 0; // Number of '{' minus number of '}'.
+    for (; *linep < limit && !parsed; *linep += 1) {
+        d->source_len += 1;
+
+        lex_line(&lx, line_start(f, *linep), line_end(f, *linep));
+        enum lex_token token;
+        while (!parsed && (token = lex_next(&lx)) != LEX_NONE) {
+            brackets += token == LEX_LBRACE;
+            brackets -= token == LEX_RBRACE;
+            parsed = brackets == 0 && token == LEX_SEMICOLON;
+        }
+    }
+}
+
+static void
+parse_function_source(struct file const* f, uint32_t* linep, struct doc* d)
+{
+    uint32_t const limit = source_limit(f, d);
+    struct lexer lx = {0};
+    bool parsed = false;
+    for (; *linep < limit && !parsed; *linep += 1) {
+        d->source_len += 1;
+
+        lex_line(&lx, line_start(f, *linep), line_end(f, *linep));
+        enum lex_token token;
+        while (!parsed && (token = lex_next(&lx)) != LEX_NONE) {
+            if (token == LEX_SEMICOLON) {
+                parsed = true;
+            }
+            else if (token == LEX_LBRACE) {
+                parsed = true;
+                d->source_elided = true;
+            }
+        }
+    }
+}
+
+static void
+parse_macro_source(struct file const* f, uint32_t* linep, struct doc* d)
+{
+    // A macro ends at the first newline that is neither spliced by a '\'
+    // nor within a block comment.
+    uint32_t const limit = source_limit(f, d);
+    // Without a character that can start a comment or literal, the macro
+    // ends at the first line that does not end with a '\'. Only the last
+    // character of each line is checked until then, and the lines are
+    // searched for such a character afterwards, once they have been read.
+    uint32_t line = *linep;
+    while (line < limit) {
+        char const* const start = line_start(f, line);
+        char const* const end = line_end(f, line);
+        line += 1;
+        if (start == end || end[-1] != '\\') {
+            break;
+        }
+    }
+    if (line == *linep) {
+        return;
+    }
+    char const* const end = line_end(f, line - 1);
+    char const* const literal = lex_skip_plain(line_start(f, *linep), end);
+    if (literal == end) {
+        d->source_len += line - *linep;
+        *linep = line;
+        return;
+    }
+
+    // The lines before the one holding the character were spliced, so the
+    // lexer starts from that line in the LEX_CODE state.
+    line = line_of(f, (uint32_t)(literal - f->text));
+    d->source_len += line - *linep;
+    *linep = line;
+    struct lexer lx = {0};
+    bool parsed = false;
+    // Such characters are searched for across lines, and up to a bounded
+    // distance so that parsing from every line of a text without any stays
+    // linear.
+    size_t const scan_ahead = 4096;
+    char const* plain = line_start(f, *linep);
+    for (; *linep < limit && !parsed; *linep += 1) {
+        d->source_len += 1;
+        char const* const start = line_start(f, *linep);
+        char const* const end = line_end(f, *linep);
+
+        if (lx.state == LEX_CODE) {
+            if (plain < end) {
+                char const* const text_end = line_end(f, limit - 1);
+                char const* const bound = (size_t)(text_end - end) > scan_ahead
+                    ? end + scan_ahead
+                    : text_end;
+                plain = lex_skip_plain(start, bound);
+            }
+            if (plain >= end) {
+                parsed = start == end || end[-1] != '\\';
+                continue;
+            }
+        }
+
+        lex_line(&lx, start, end);
+        enum lex_token token;
+        while (!parsed && (token = lex_next(&lx)) != LEX_NONE) {
+            parsed = token == LEX_EOL;
+        }
+    }
+}
+
+static uint32_t
+source_limit(struct file const* f, struct doc const* d)
+{
+    if (!d->skipped || f->partial || f->doc_line_count == 0) {
+        return f->line_count;
+    }
+    uint32_t const last = f->doc_lines[f->doc_line_count - 1];
+    return last < f->line_count ? last + 1 : f->line_count;
+}
+
+static bool
+parse_doc(
+    struct job* job, struct file const* f, uint32_t* linep, struct doc* dp)
+{
+    struct doc d = {0};
+
+    // Locate the bounds of the doc comment block.
+    uint32_t const first_line = *linep;
+    char const* start = line_start(f, first_line);
+    while (is_hspace(*start)) {
+        start += 1;
+    }
+    char const* const content = start + 3; // Move past "/*!".
+
+    uint32_t last_line = first_line;
+    char const* end = find_comment_end(content, line_end(f, first_line));
+    while (end == NULL && last_line + 1 < f->line_count) {
+        last_line += 1;
+        end = find_comment_end(
+            line_start(f, last_line), line_end(f, last_line));
+    }
+    if (end == NULL) {
+        end = line_end(f, last_line);
+    }
+    uint32_t const comment_end = (uint32_t)(end - f->text);
+
+    // Parse the lines of the block into sections.
+    size_t section_cap = 0;
+    uint32_t line = first_line;
+    while (line <= last_line) {
+        char const* begin = line == first_line ? content : line_start(f, line);
+        char const* stop = line == last_line ? end : line_end(f, line);
+        char const* cleaned = clean_doc_line(begin, stop);
+        if (cleaned != stop && *cleaned == '@') {
+            d.sections = arena_push(
+                job->arena,
+                d.sections,
+                &section_cap,
+                d.section_count,
+                sizeof(*d.sections));
+            struct section* const s = &d.sections[d.section_count++];
+            if (!parse_section(
+                    job, f, cleaned, stop, &line, last_line, comment_end, s)) {
+                *linep = last_line + 1;
+                return false;
+            }
+        }
+        else {
+            line += 1; // Skip empty lines between sections
+        }
+    }
+
+    *linep = last_line + 1; // Consume the line with the end of the comment.
+
+    // The filters only need the sections, so a skipped doc is known before
+    // its source is parsed. The source is still parsed so that the doc
+    // comments within it are not taken for docs of their own, but only up
+    // to the last doc comment of the text.
+    d.skipped = !doc_is_selected(job, f, &d);
+    if (d.section_count == 0) {
+        *dp = d;
+        return true;
+    }
+
+    // Parse associated source code.
+    d.source_start = *linep;
+    switch (d.sections[0].tag) {
+    case TAG_STRUCT:
+    case TAG_UNION:
+    case TAG_ENUM:
+    case TAG_TYPEDEF:
+    case TAG_VARIABLE:
+        d.has_source = true;
+        parse_struct_source(f, linep, &d);
+        break;
+    case TAG_FUNCTION:
+        d.has_source = true;
+        parse_function_source(f, linep, &d);
+        break;
+    case TAG_MACRO:
+        d.has_source = true;
+        parse_macro_source(f, linep, &d);
+        break;
+    default:
+        break;
+    }
+
+    *dp = d;
+    return true;
+}
+
+static bool
+doc_is_selected(struct job* job, struct file const* f, struct doc const* d)
+{
+    struct options const* const options = job->options;
+    if (d->section_count == 0) {
+        return options->only_count == 0 && options->name_count == 0;
+    }
+    struct section const* const first = &d->sections[0];
+    if (options->only_count != 0
+        && !match_tag(options->only, options->only_count, f, first)) {
+        return false;
+    }
+    for (size_t i = 0; i < d->section_count; ++i) {
+        if (match_tag(
+                options->exclude_tags,
+                options->exclude_tag_count,
+                f,
+                &d->sections[i])) {
+            return false;
+        }
+    }
+    if (options->name_count == 0 && options->exclude_name_count == 0) {
+        return true;
+    }
+
+    if (first->name_len == 0) {
+        return options->name_count == 0;
+    }
+    char* const name = arena_alloc(job->arena, first->name_len + 1);
+    memcpy(name, f->text + first->name_start, first->name_len);
+    name[first->name_len] = '\0';
+    if (options->name_count != 0
+        && !match_name(options->names, options->name_count, name)) {
+        return false;
+    }
+    return !match_name(
+        options->exclude_names, options->exclude_name_count, name);
+}
+
+static bool
+match_tag(
+    struct tag_pattern const* patterns,
+    size_t count,
+    struct file const* f,
+    struct section const* s)
+{
+    for (size_t i = 0; i < count; ++i) {
+        struct tag_pattern const* const p = &patterns[i];
+        if (p->tag != TAG_UNKNOWN) {
+            if (s->tag == p->tag) {
+                return true;
+            }
+        }
+        else if (
+            s->tag_len == p->len
+            && memcmp(f->text + s->tag_start, p->str, p->len) == 0) {
+            return true;
+        }
+    }
+    return false;
+}
+
+static bool
+match_name(char const* const* patterns, size_t count, char const* name)
+{
+    for (size_t i = 0; i < count; ++i) {
+        if (fnmatch(patterns[i], name, 0) == 0) {
+            return true;
+        }
+    }
+    return false;
+}
+
+#if !defined(CDOC_NO_MAIN)
+static void
+print_doc(struct output* o, struct file const* f, struct doc const* d)
+{
+    if (o->renderer->print_doc != NULL) {
+        o->renderer->print_doc(o, f, d);
+        return;
+    }
+    print_doc_with(o, f, d, o->renderer);
+}
+
+static ALWAYS_INLINE void
+print_doc_with(
+    struct output* o,
+    struct file const* f,
+    struct doc const* d,
+    struct renderer const* r)
+{
+    o->doc_name = NULL;
+    o->doc_name_len = 0;
+    if (d->section_count != 0) {
+        o->doc_name = f->text + d->sections[0].name_start;
+        o->doc_name_len = d->sections[0].name_len;
+    }
+    if (r->begin_doc != NULL) {
+        r->begin_doc(o, d);
+    }
+    for (size_t i = 0; i < d->section_count; ++i) {
+        o->section_index = i;
+        o->section_tag = d->sections[i].tag;
+        print_section(o, f, &d->sections[i], r);
+    }
+    if (d->has_source) {
+        if (r->begin_source != NULL) {
+            r->begin_source(o);
+        }
+        for (uint32_t i = 0; i < d->source_len; ++i) {
+            char const* const start = line_start(f, d->source_start + i);
+            char const* const end = line_end(f, d->source_start + i);
+            if (!is_doc_comment(start, end)) {
+                r->source_line(o, start, (size_t)(end - start));
+            }
+        }
+        if (r->end_source != NULL) {
+            r->end_source(o, d->source_elided);
+        }
+    }
+    if (r->end_doc != NULL) {
+        r->end_doc(o, d);
+    }
+}
+
+static uint32_t
+count_doc(struct symtab* names, struct file const* f, struct doc const* d)
+{
+    if (d->section_count == 0 || d->sections[0].name_len == 0) {
+        return 0;
+    }
+    struct symtab_slot* const slot = symtab_intern(
+        names, f->text + d->sections[0].name_start, d->sections[0].name_len);
+    slot->first = slot->first == SYMBOL_NONE ? 1 : slot->first + 1;
+    return slot->first;
+}
+
+static void
+write_doc_suffix(struct sink* s, struct output const* o)
+{
+    if (o->doc_ordinal > 1) {
+        char buf[16];
+        int const len = snprintf(buf, sizeof(buf), "-%" PRIu32, o->doc_ordinal);
+        sink_write(s, buf, (size_t)len);
+    }
+}
+#endif
+
+static bool
+parse_section(
+    struct job* job,
+    struct file const* f,
+    char const* line,
+    char const* end,
+    uint32_t* linep,
+    uint32_t last_line,
+    uint32_t comment_end,
+    struct section* sp)
+{
+    struct section s = {0};
+    char const* cp = line;
+
+    if (cp == end || *cp++ != '@') {
+        return job_errorf(
+            job,
+            "[line %d] Doc-section must begin with @<TAG>",
+            LINENO(f->first_line + *linep));
+    }
+    if (cp == end || is_hspace(*cp)) {
+        return job_errorf(
+            job,
+            "[line %d] Empty doc-comment tag",
+            LINENO(f->first_line + *linep));
+    }
+
+    // TAG
+    s.tag_start = (uint32_t)(cp - f->text);
+    while (cp != end && !is_hspace(*cp)) {
+        cp += 1;
+    }
+    s.tag_len = (uint32_t)(cp - f->text) - s.tag_start;
+    s.tag = find_tag(f->text + s.tag_start, s.tag_len);
+
+    while (cp != end && is_hspace(*cp)) {
+        cp += 1;
+    }
+
+    // NAME
+    s.name_start = (uint32_t)(cp - f->text);
+    while (cp != end && !is_hspace(*cp)) {
+        cp += 1;
+    }
+    s.name_len = (uint32_t)(cp - f->text) - s.name_start;
+
+    while (cp != end && is_hspace(*cp)) {
+        cp += 1;
+    }
+    if (cp != end) {
+        return job_errorf(
+            job,
+            "[line %d] Extra character(s) after tag line <NAME>",
+            LINENO(f->first_line + *linep));
+    }
+
+    // TEXT
+    *linep += 1;
+    s.text_start = *linep;
+    s.text_end = comment_end;
+    while (*linep <= last_line) {
+        char const* const start = line_start(f, *linep);
+        char const* const stop =
+            *linep == last_line ? f->text + comment_end : line_end(f, *linep);
+        char const* const peek = clean_doc_line(start, stop);
+        if (peek != stop && *peek == '@') break;
+        *linep += 1;
+    }
+    s.text_len = *linep - s.text_start;
+
+    *sp = s;
+    return true;
+}
+
+static enum tag
+find_tag(char const* tag, size_t len)
+{
+#define TAG_MATCH(str, id) (memcmp(tag, str, len) == 0 ? (id) : TAG_UNKNOWN)
+    switch (len) {
+    case 3:
+        return TAG_MATCH("see", TAG_SEE);
+    case 4:
+        switch (tag[0]) {
+        case 'e':
+            return TAG_MATCH("enum", TAG_ENUM);
+        case 'f':
+            return TAG_MATCH("file", TAG_FILE);
+        case 'n':
+            return TAG_MATCH("note", TAG_NOTE);
+        case 't':
+            return TAG_MATCH("todo", TAG_TODO);
+        }
+        break;
+    case 5:
+        switch (tag[0]) {
+        case 'm':
+            return TAG_MATCH("macro", TAG_MACRO);
+        case 'p':
+            return TAG_MATCH("param", TAG_PARAM);
+        case 'u':
+            return TAG_MATCH("union", TAG_UNION);
+        }
+        break;
+    case 6:
+        switch (tag[0]) {
+        case 'm':
+            return TAG_MATCH("member", TAG_MEMBER);
+        case 'r':
+            return TAG_MATCH("return", TAG_RETURN);
+        case 's':
+            return TAG_MATCH("struct", TAG_STRUCT);
+        }
+        break;
+    case 7:
+        switch (tag[0]) {
+        case 'l':
+            return TAG_MATCH("license", TAG_LICENSE);
+        case 't':
+            return TAG_MATCH("typedef", TAG_TYPEDEF);
+        }
+        break;
+    case 8:
+        switch (tag[0]) {
+        case 'f':
+            return TAG_MATCH("function", TAG_FUNCTION);
+        case 'v':
+            return TAG_MATCH("variable", TAG_VARIABLE);
+        }
+        break;
+    }
+#undef TAG_MATCH
+    return TAG_UNKNOWN;
+}
+
+#if !defined(CDOC_NO_MAIN)
+static ALWAYS_INLINE void
+print_section(
+    struct output* o,
+    struct file const* f,
+    struct section const* s,
+    struct renderer const* r)
+{
+    r->section_header(
+        o,
+        f->text + s->tag_start,
+        s->tag_len,
+        f->text + s->name_start,
+        s->name_len);
+    for (uint32_t i = 0; i < s->text_len; ++i) {
+        uint32_t const line = s->text_start + i;
+        char const* const start = line_start(f, line);
+        char const* end = line_end(f, line);
+        if (end > f->text + s->text_end) {
+            end = f->text + s->text_end;
+        }
+        char const* const text = clean_doc_line(start, end);
+        r->text_line(o, text, (size_t)(end - text));
+    }
+    if (r->end_section != NULL) {
+        r->end_section(o);
+    }
+}
+
+// HTML renderer.
+static void
+html_end_doc(struct output* o, struct doc const* d)
+{
+    (void)d;
+    SINK_LITERAL(o->sink, "<hr>\n");
+}
+
+static void
+html_section_header(
+    struct output* o,
+    char const* tag,
+    size_t tag_len,
+    char const* name,
+    size_t name_len)
+{
+    // The first section of a doc is anchored by its name, and every other
+    // section by the doc name followed by its own name or tag. A doc that
+    // repeats the name of an earlier doc of the file adds its suffix to the
+    // doc name, so that the anchors of the page stay unique.
+    SINK_LITERAL(o->sink, "<h3 id=\"");
+    if (o->section_index != 0 && o->doc_name_len != 0) {
+        html_write_anchor(o->sink, o->doc_name, o->doc_name_len);
+        write_doc_suffix(o->sink, o);
+        sink_write(o->sink, ".", 1);
+    }
+    if (name_len != 0) {
+        html_write_anchor(o->sink, name, name_len);
+    }
+    else {
+        html_write_anchor(o->sink, tag, tag_len);
+    }
+    if (o->section_index == 0) {
+        write_doc_suffix(o->sink, o);
+    }
+    SINK_LITERAL(o->sink, "\">");
+    html_write_text(o->sink, tag, tag_len);
+    SINK_LITERAL(o->sink, ": ");
+    // Pages are rendered before the docs of later files are known, so a
+    // @see links to an anchor of its own page; render_index warns about
+    // the names that --output-dir places on other pages.
+    if (name_len != 0 && o->section_tag == TAG_SEE) {
+        SINK_LITERAL(o->sink, "<a href=\"#");
+        html_write_anchor(o->sink, name, name_len);
+        SINK_LITERAL(o->sink, "\">");
+        html_write_text(o->sink, name, name_len);
+        SINK_LITERAL(o->sink, "</a>");
+    }
+    else {
+        html_write_text(o->sink, name, name_len);
+    }
+    SINK_LITERAL(o->sink, "</h3>\n");
+}
+
+static void
+html_begin_source(struct output* o)
+{
+    SINK_LITERAL(o->sink, "<pre><code>\n");
+}
+
+// Doc text is HTML already, but source code is escaped.
+static void
+html_source_line(struct output* o, char const* line, size_t len)
+{
+    html_write_line(o->sink, line, len);
+}
+
+static void
+html_end_source(struct output* o, bool elided)
+{
+    if (elided) {
+        SINK_LITERAL(o->sink, "/* function definition... */\n");
+    }
+    SINK_LITERAL(o->sink, "</code></pre>\n");
+}
+
+// Highlighting HTML renderer, which wraps the keywords, literals, comments,
+// and preprocessing directives of source lines in spans. Comments and
+// literals are followed across lines by the transition table of the lexer
+// the source parsers use.
+// clang-format off
+static char const* const html_keywords[256] = {
+    [4] = "_Imaginary",
+    [8] = "register",
+    [18] = "default",
+    [21] = "char",
+    [24] = "case",
+    [26] = "bool",
+    [29] = "false",
+    [30] = "enum",
+    [34] = "restrict",
+    [45] = "_Decimal32",
+    [51] = "break",
+    [61] = "union",
+    [63] = "do",
+    [65] = "short",
+    [67] = "_Static_assert",
+    [70] = "goto",
+    [71] = "_Decimal64",
+    [82] = "_Alignas",
+    [86] = "alignas",
+    [90] = "typeof",
+    [91] = "switch",
+    [92] = "typedef",
+    [99] = "if",
+    [100] = "float",
+    [105] = "_BitInt",
+    [106] = "for",
+    [115] = "constexpr",
+    [123] = "int",
+    [125] = "_Decimal128",
+    [127] = "signed",
+    [128] = "_Atomic",
+    [130] = "while",
+    [133] = "const",
+    [136] = "auto",
+    [153] = "sizeof",
+    [158] = "else",
+    [167] = "extern",
+    [169] = "_Alignof",
+    [171] = "_Complex",
+    [173] = "alignof",
+    [175] = "_Noreturn",
+    [182] = "typeof_unqual",
+    [190] = "inline",
+    [193] = "unsigned",
+    [194] = "nullptr",
+    [197] = "double",
+    [198] = "void",
+    [200] = "continue",
+    [202] = "_Generic",
+    [208] = "return",
+    [211] = "struct",
+    [219] = "volatile",
+    [225] = "static_assert",
+    [227] = "long",
+    [229] = "_Thread_local",
+    [232] = "thread_local",
+    [245] = "true",
+    [246] = "static",
+    [253] = "_Bool",
+};
+// clang-format on
+
+static bool
+html_is_keyword(char const* text, size_t len)
+{
+    if (len < 2 || len > 14) {
+        return false;
+    }
+    // Every keyword has a distinct hash, so one comparison decides.
+    unsigned char const* const u = (unsigned char const*)text;
+    size_t const hash = (u[0] + 12 * u[1] + 13 * u[len - 1] + 2 * len) & 0xff;
+    char const* const keyword = html_keywords[hash];
+    return keyword != NULL && strncmp(keyword, text, len) == 0
+        && keyword[len] == '\0';
+}
+
+static bool
+html_is_ident(unsigned char c)
+{
+    return (c >= 'a' && c <= 'z') || (c >= 'A' && c <= 'Z')
+        || (c >= '0' && c <= '9') || c == '_' || c >= 0x80;
+}
+
+static void
+html_write_span(
+    struct sink* s, char const* class, char const* text, size_t size)
+{
+    SINK_LITERAL(s, "<span class=\"");
+    sink_puts(s, class);
+    SINK_LITERAL(s, "\">");
+    html_write_text(s, text, size);
+    SINK_LITERAL(s, "</span>");
+}
+
+static void
+html_highlight_begin_source(struct output* o)
+{
+    o->source_state = LEX_CODE;
+    o->source_bol = true;
+    html_begin_source(o);
+}
+
+static void
+html_highlight_line(struct output* o, char const* line, size_t len)
+{
+    struct sink* const s = o->sink;
+    char const* cp = line;
+    char const* const end = line + len;
+    unsigned state = o->source_state;
+    bool directive = o->source_bol; // May a '#' begin a directive?
+    bool include = false; // Does a '<' begin a header name?
+    while (cp != end) {
+        char const* const start = cp;
+        unsigned char const c = (unsigned char)*cp;
+        if (state == LEX_CODE) {
+            if (c == ' ' || c == '\t') {
+                while (cp != end && (*cp == ' ' || *cp == '\t')) {
+                    cp += 1;
+                }
+                html_write_text(s, start, (size_t)(cp - start));
+                continue;
+            }
+            bool const at_directive = directive;
+            bool const at_include = include;
+            directive = false;
+            include = false;
+            if (c == '/' && end - cp > 1 && (cp[1] == '/' || cp[1] == '*')) {
+                state = cp[1] == '/' ? LEX_LINE_COMMENT : LEX_BLOCK_COMMENT;
+                cp += 2;
+            }
+            else if (c == '"' || c == '\'') {
+                state = c == '"' ? LEX_STRING : LEX_CHAR;
+                cp += 1;
+            }
+            else if (c == '<' && at_include) {
+                char const* const gt = memchr(cp, '>', (size_t)(end - cp));
+                cp = gt != NULL ? gt + 1 : end;
+                html_write_span(s, "str", start, (size_t)(cp - start));
+                continue;
+            }
+            else if (c == '#' && at_directive) {
+                cp += 1;
+                while (cp != end && (*cp == ' ' || *cp == '\t')) {
+                    cp += 1;
+                }
+                char const* const name = cp;
+                while (cp != end && html_is_ident((unsigned char)*cp)) {
+                    cp += 1;
+                }
+                include = cp - name == 7 && memcmp(name, "include", 7) == 0;
+                html_write_span(s, "pp", start, (size_t)(cp - start));
+                continue;
+            }
+            else if (
+                (c >= '0' && c <= '9')
+                || (c == '.' && end - cp > 1 && cp[1] >= '0' && cp[1] <= '9')) {
+                // A preprocessing number, whose exponents may have a sign.
+                do {
+                    unsigned char const prev = (unsigned char)*cp++;
+                    if (cp != end && (*cp == '+' || *cp == '-')
+                        && ((prev | 0x20) == 'e' || (prev | 0x20) == 'p')) {
+                        cp += 1;
+                    }
+                } while (cp != end
+                         && (html_is_ident((unsigned char)*cp) || *cp == '.'
+                             || *cp == '\''));
+                html_write_span(s, "num", start, (size_t)(cp - start));
+                continue;
+            }
+            else if (html_is_ident(c)) {
+                while (cp != end && html_is_ident((unsigned char)*cp)) {
+                    cp += 1;
+                }
+                size_t const size = (size_t)(cp - start);
+                if (html_is_keyword(start, size)) {
+                    html_write_span(s, "kw", start, size);
+                }
+                else {
+                    html_write_text(s, start, size);
+                }
+                continue;
+            }
+            else {
+                // Punctuation up to the next character that may begin a
+                // token of its own.
+                do {
+                    cp += 1;
+                } while (cp != end && !html_is_ident((unsigned char)*cp)
+                         && strchr(" \t\"'/.", *cp) == NULL);
+                html_write_text(s, start, (size_t)(cp - start));
+                continue;
+            }
+        }
+        // The comment or literal continues until the lexer is back in code.
+        char const* const class = state >= LEX_STRING ? "str" : "com";
+        while (cp != end && state != LEX_CODE) {
+            state = lex_table[state][lex_classes[(unsigned char)*cp++]].state;
+        }
+        html_write_span(s, class, start, (size_t)(cp - start));
+    }
+    sink_write(s, "\n", 1);
+    o->source_bol = state == LEX_CODE && (len == 0 || line[len - 1] != '\\');
+    o->source_state = lex_table[state][LEX_C_NEWLINE].state;
+}
+
+static void
+html_highlight_end_source(struct output* o, bool elided)
+{
+    if (elided) {
+        html_write_span(
+            o->sink, "com", "/* function definition... */", 28);
+        sink_write(o->sink, "\n", 1);
+    }
+    SINK_LITERAL(o->sink, "</code></pre>\n");
+}
+
+// Markdown renderer.
+static void
+md_end_doc(struct output* o, struct doc const* d)
+{
+    (void)d;
+    SINK_LITERAL(o->sink, "\n---\n");
+}
+
+static void
+md_section_header(
+    struct output* o,
+    char const* tag,
+    size_t tag_len,
+    char const* name,
+    size_t name_len)
+{
+    SINK_LITERAL(o->sink, "### ");
+    sink_write(o->sink, tag, tag_len);
+    SINK_LITERAL(o->sink, ": ");
+    sink_write(o->sink, name, name_len);
+    SINK_LITERAL(o->sink, "\n");
+}
+
+static void
+md_begin_source(struct output* o)
+{
+    SINK_LITERAL(o->sink, "```c\n");
+}
+
+static void
+md_end_source(struct output* o, bool elided)
+{
+    if (elided) {
+        SINK_LITERAL(o->sink, "/* function definition... */\n");
+    }
+    SINK_LITERAL(o->sink, "```\n");
+}
+
+// Shared by the Markdown renderer and the doc text of the HTML renderer,
+// which write lines verbatim.
+static void
+raw_line(struct output* o, char const* line, size_t len)
+{
+    sink_write_line(o->sink, line, len);
+}
+
+// JSON renderer, writing one object per file on a line of its own.
+static void
+json_separate(struct output* o)
+{
+    if (!o->first) {
+        sink_write(o->sink, ",", 1);
+    }
+    o->first = false;
+}
+
+static void
+json_begin_file(struct output* o, char const* path)
+{
+    SINK_LITERAL(o->sink, "{\"file\":");
+    json_write_string(o->sink, path, strlen(path));
+    SINK_LITERAL(o->sink, ",\"docs\":[");
+    o->first = true;
+}
+
+static void
+json_end_file(struct output* o)
+{
+    SINK_LITERAL(o->sink, "]}\n");
+}
+
+static void
+json_begin_doc(struct output* o, struct doc const* d)
+{
+    (void)d;
+    json_separate(o);
+    SINK_LITERAL(o->sink, "{\"sections\":[");
+    o->first = true;
+}
+
+static void
+json_end_doc(struct output* o, struct doc const* d)
+{
+    if (d->has_source) {
+        SINK_LITERAL(o->sink, "}");
+    }
+    else {
+        SINK_LITERAL(o->sink, "]}");
+    }
+    o->first = false;
+}
+
+static void
+json_section_header(
+    struct output* o,
+    char const* tag,
+    size_t tag_len,
+    char const* name,
+    size_t name_len)
+{
+    json_separate(o);
+    SINK_LITERAL(o->sink, "{\"tag\":");
+    json_write_string(o->sink, tag, tag_len);
+    if (name_len != 0) {
+        SINK_LITERAL(o->sink, ",\"name\":");
+        json_write_string(o->sink, name, name_len);
+    }
+    SINK_LITERAL(o->sink, ",\"text\":[");
+    o->first = true;
+}
+
+static void
+json_line(struct output* o, char const* line, size_t len)
+{
+    json_separate(o);
+    json_write_string(o->sink, line, len);
+}
+
+static void
+json_end_section(struct output* o)
+{
+    SINK_LITERAL(o->sink, "]}");
+    o->first = false;
+}
+
+static void
+json_begin_source(struct output* o)
+{
+    SINK_LITERAL(o->sink, "],\"source\":[");
+    o->first = true;
+}
+
+static void
+json_end_source(struct output* o, bool elided)
+{
+    if (elided) {
+        SINK_LITERAL(o->sink, "],\"elided\":true");
+    }
+    else {
+        SINK_LITERAL(o->sink, "],\"elided\":false");
+    }
+}
+
+// Manual page renderer, writing one page per file.
+static void
+man_begin_file(struct output* o, char const* path)
+{
+    SINK_LITERAL(o->sink, ".TH \"");
+    man_write_text(o->sink, path, strlen(path));
+    SINK_LITERAL(o->sink, "\" 3 \"\" \"cdoc " VERSION "\"\n");
+}
+
+static void
+man_section_header(
+    struct output* o,
+    char const* tag,
+    size_t tag_len,
+    char const* name,
+    size_t name_len)
+{
+    SINK_LITERAL(o->sink, ".SS ");
+    man_write_text(o->sink, tag, tag_len);
+    SINK_LITERAL(o->sink, ": ");
+    man_write_text(o->sink, name, name_len);
+    SINK_LITERAL(o->sink, "\n");
+}
+
+static void
+man_line(struct output* o, char const* line, size_t len)
+{
+    man_write_line(o->sink, line, len);
+}
+
+static void
+man_begin_source(struct output* o)
+{
+    SINK_LITERAL(o->sink, ".PP\n.nf\n");
+}
+
+static void
+man_end_source(struct output* o, bool elided)
+{
+    if (elided) {
+        SINK_LITERAL(o->sink, "/* function definition... */\n");
+    }
+    SINK_LITERAL(o->sink, ".fi\n");
+}
+
+DEFINE_PRINT_DOC(html)
+static struct renderer const html_renderer = {
+    .name = "html",
+    .end_doc = html_end_doc,
+    .section_header = html_section_header,
+    .text_line = raw_line,
+    .begin_source = html_begin_source,
+    .source_line = html_source_line,
+    .end_source = html_end_source,
+    .print_doc = html_print_doc,
+};
+
+DEFINE_PRINT_DOC(html_highlight)
+static struct renderer const html_highlight_renderer = {
+    .name = "html",
+    .end_doc = html_end_doc,
+    .section_header = html_section_header,
+    .text_line = raw_line,
+    .begin_source = html_highlight_begin_source,
+    .source_line = html_highlight_line,
+    .end_source = html_highlight_end_source,
+    .print_doc = html_highlight_print_doc,
+};
+
+DEFINE_PRINT_DOC(md)
+static struct renderer const md_renderer = {
+    .name = "md",
+    .end_doc = md_end_doc,
+    .section_header = md_section_header,
+    .text_line = raw_line,
+    .begin_source = md_begin_source,
+    .source_line = raw_line,
+    .end_source = md_end_source,
+    .print_doc = md_print_doc,
+};
+
+DEFINE_PRINT_DOC(json)
+static struct renderer const json_renderer = {
+    .name = "json",
+    .begin_file = json_begin_file,
+    .end_file = json_end_file,
+    .begin_doc = json_begin_doc,
+    .end_doc = json_end_doc,
+    .section_header = json_section_header,
+    .text_line = json_line,
+    .end_section = json_end_section,
+    .begin_source = json_begin_source,
+    .source_line = json_line,
+    .end_source = json_end_source,
+    .print_doc = json_print_doc,
+};
+
+DEFINE_PRINT_DOC(man)
+static struct renderer const man_renderer = {
+    .name = "man",
+    .begin_file = man_begin_file,
+    .section_header = man_section_header,
+    .text_line = man_line,
+    .begin_source = man_begin_source,
+    .source_line = man_line,
+    .end_source = man_end_source,
+    .print_doc = man_print_doc,
+};
+
+// Formats selected by --format and --out.
+static struct renderer const* const renderers[] = {
+    &html_renderer,
+    &md_renderer,
+    &json_renderer,
+    &man_renderer,
+};
+
+// Symbol renderer, recording the names defined and referenced by each doc.
+static void
+symbols_begin_file(struct output* o, char const* path)
+{
+    sink_write(o->sink, "F", 1);
+    sink_write(o->sink, path, strlen(path) + 1);
+}
+
+static void
+symbols_section_header(
+    struct output* o,
+    char const* tag,
+    size_t tag_len,
+    char const* name,
+    size_t name_len)
+{
+    if (name_len == 0) {
+        return;
+    }
+    bool const see = o->section_tag == TAG_SEE;
+    if (o->section_index == 0 && !see) {
+        sink_write(o->sink, "D", 1);
+        sink_write(o->sink, tag, tag_len);
+        sink_write(o->sink, "", 1);
+        sink_write(o->sink, name, name_len);
+        sink_write(o->sink, "", 1);
+        write_doc_suffix(o->sink, o);
+        sink_write(o->sink, "", 1);
+    }
+    if (see) {
+        sink_write(o->sink, "R", 1);
+        sink_write(o->sink, name, name_len);
+        sink_write(o->sink, "", 1);
+    }
+}
+
+static void
+symbols_line(struct output* o, char const* line, size_t len)
+{
+    (void)o;
+    (void)line;
+    (void)len;
+}
+
+static struct renderer const symbol_renderer = {
+    .name = "symbols",
+    .begin_file = symbols_begin_file,
+    .section_header = symbols_section_header,
+    .text_line = symbols_line,
+    .source_line = symbols_line,
+};
+
+// IR renderer, writing one ir_chunk per file. Only the lines spanned by each
+// doc are kept, each doc getting its own copy of its lines.
+static bool
+ir_doc_lines(
+    struct file const* f, struct doc const* d, uint32_t* lo, uint32_t* hi)
+{
+    bool any = false;
+    for (size_t i = 0; i < d->section_count; ++i) {
+        struct section const* const s = &d->sections[i];
+        uint32_t const first = line_of(f, s->tag_start);
+        uint32_t last = line_of(f, s->text_end);
+        if (s->text_len != 0 && s->text_start + s->text_len - 1 > last) {
+            last = s->text_start + s->text_len - 1;
+        }
+        *lo = any && *lo < first ? *lo : first;
+        *hi = any && *hi > last ? *hi : last;
+        any = true;
+    }
+    if (d->has_source && d->source_len != 0) {
+        uint32_t const first = d->source_start;
+        uint32_t const last = d->source_start + d->source_len - 1;
+        *lo = any && *lo < first ? *lo : first;
+        *hi = any && *hi > last ? *hi : last;
+        any = true;
+    }
+    return any;
+}
+
+static uint32_t
+ir_map_offset(struct file const* f, uint32_t lo, uint32_t base, uint32_t at)
+{
+    // base is the offset in the chunk text of the start of line lo.
+    return base + (at - f->lines[lo]);
+}
+
+static void
+ir_render_file(
+    struct output* o,
+    char const* path,
+    struct file const* f,
+    struct doc const* docs,
+    size_t count)
+{
+    struct ir_chunk c = {0};
+    uint32_t lo;
+    uint32_t hi;
+    for (size_t i = 0; i < count; ++i) {
+        if (ir_doc_lines(f, &docs[i], &lo, &hi)) {
+            c.line_count += hi - lo + 1;
+            c.text_size += f->lines[hi + 1] - f->lines[lo];
+        }
+        c.section_count += (uint32_t)docs[i].section_count;
+    }
+    size_t const path_size = strlen(path) + 1;
+    c.doc_count = (uint32_t)count;
+    c.lines = sizeof(c);
+    c.docs = c.lines + (c.line_count + 1) * (uint32_t)sizeof(uint32_t);
+    c.sections = c.docs + c.doc_count * (uint32_t)sizeof(struct ir_doc);
+    c.path = c.sections
+           + c.section_count * (uint32_t)sizeof(struct section);
+    c.text = c.path + (uint32_t)path_size;
+    c.size = (c.text + c.text_size + IR_ALIGN - 1) & ~(uint32_t)(IR_ALIGN - 1);
+    sink_write(o->sink, (char const*)&c, sizeof(c));
+
+    uint32_t base = 0;
+    for (size_t i = 0; i < count; ++i) {
+        if (!ir_doc_lines(f, &docs[i], &lo, &hi)) {
+            continue;
+        }
+        for (uint32_t line = lo; line <= hi; ++line) {
+            uint32_t const offset = ir_map_offset(f, lo, base, f->lines[line]);
+            sink_write(o->sink, (char const*)&offset, sizeof(offset));
+        }
+        base += f->lines[hi + 1] - f->lines[lo];
+    }
+    sink_write(o->sink, (char const*)&c.text_size, sizeof(c.text_size));
+
+    uint32_t section_first = 0;
+    uint32_t line_base = 0;
+    for (size_t i = 0; i < count; ++i) {
+        struct doc const* const d = &docs[i];
+        bool const any = ir_doc_lines(f, d, &lo, &hi);
+        struct ir_doc r = {0};
+        r.section_first = section_first;
+        r.section_count = (uint32_t)d->section_count;
+        if (d->has_source && d->source_len != 0) {
+            r.source_start = line_base + (d->source_start - lo);
+            r.source_len = d->source_len;
+        }
+        r.flags = (d->has_source ? IR_HAS_SOURCE : 0)
+                | (d->source_elided ? IR_SOURCE_ELIDED : 0);
+        sink_write(o->sink, (char const*)&r, sizeof(r));
+        section_first += r.section_count;
+        line_base += any ? hi - lo + 1 : 0;
+    }
+
+    base = 0;
+    line_base = 0;
+    for (size_t i = 0; i < count; ++i) {
+        struct doc const* const d = &docs[i];
+        if (!ir_doc_lines(f, d, &lo, &hi)) {
+            continue;
+        }
+        for (size_t j = 0; j < d->section_count; ++j) {
+            struct section s = d->sections[j];
+            s.tag_start = ir_map_offset(f, lo, base, s.tag_start);
+            s.name_start = ir_map_offset(f, lo, base, s.name_start);
+            s.text_end = ir_map_offset(f, lo, base, s.text_end);
+            s.text_start = line_base + (s.text_start - lo);
+            sink_write(o->sink, (char const*)&s, sizeof(s));
+        }
+        base += f->lines[hi + 1] - f->lines[lo];
+        line_base += hi - lo + 1;
+    }
+
+    sink_write(o->sink, path, path_size);
+    for (size_t i = 0; i < count; ++i) {
+        if (!ir_doc_lines(f, &docs[i], &lo, &hi)) {
+            continue;
+        }
+        // The last line of a file may lack the newline every line of the
+        // chunk ends with.
+        size_t const size = f->lines[hi + 1] - f->lines[lo] - 1;
+        sink_write(o->sink, f->text + f->lines[lo], size);
+        sink_write(o->sink, "\n", 1);
+    }
+    static char const padding[IR_ALIGN] = {0};
+    sink_write(o->sink, padding, c.size - (c.text + c.text_size));
+}
+
+static void
+ir_line(struct output* o, char const* line, size_t len)
+{
+    (void)o;
+    (void)line;
+    (void)len;
+}
+
+static void
+ir_section_header(
+    struct output* o,
+    char const* tag,
+    size_t tag_len,
+    char const* name,
+    size_t name_len)
+{
+    (void)o;
+    (void)tag;
+    (void)tag_len;
+    (void)name;
+    (void)name_len;
+}
+
+static struct renderer const ir_renderer = {
+    .name = "ir",
+    .section_header = ir_section_header,
+    .text_line = ir_line,
+    .source_line = ir_line,
+    .render_file = ir_render_file,
+};
+
+// Search renderer, recording the docs and tokens of each file.
+static void
+search_write_token(struct sink* s, char const* token, size_t len)
+{
+    if (len < 2 || len > SEARCH_TOKEN_MAX) {
+        return;
+    }
+    char record[SEARCH_TOKEN_MAX + 2];
+    record[0] = 'T';
+    for (size_t i = 0; i < len; ++i) {
+        char const c = token[i];
+        record[i + 1] = c >= 'A' && c <= 'Z' ? (char)(c - 'A' + 'a') : c;
+    }
+    record[len + 1] = '\0';
+    sink_write(s, record, len + 2);
+}
+
+static void
+search_write_tokens(struct sink* s, char const* text, size_t size)
+{
+    char const* const end = text + size;
+    char const* cp = text;
+    while (cp != end) {
+        char const* const start = cp;
+        bool split = false;
+        for (; cp != end; ++cp) {
+            char const c = *cp;
+            if (!((c >= 'a' && c <= 'z') || (c >= 'A' && c <= 'Z')
+                    || (c >= '0' && c <= '9') || c == '_')) {
+                break;
+            }
+            split = split || c == '_';
+        }
+        if (cp == start) {
+            ++cp;
+            continue;
+        }
+        search_write_token(s, start, (size_t)(cp - start));
+        if (split) {
+            char const* part = start;
+            for (char const* p = start; p != cp + 1; ++p) {
+                if (p == cp || *p == '_') {
+                    search_write_token(s, part, (size_t)(p - part));
+                    part = p + 1;
+                }
+            }
+        }
+    }
+}
+
+static void
+search_section_header(
+    struct output* o,
+    char const* tag,
+    size_t tag_len,
+    char const* name,
+    size_t name_len)
+{
+    if (o->section_index == 0) {
+        sink_write(o->sink, "D", 1);
+        sink_write(o->sink, tag, tag_len);
+        sink_write(o->sink, "", 1);
+        sink_write(o->sink, name, name_len);
+        sink_write(o->sink, "", 1);
+        write_doc_suffix(o->sink, o);
+        sink_write(o->sink, "", 1);
+    }
+    search_write_tokens(o->sink, tag, tag_len);
+    search_write_tokens(o->sink, name, name_len);
+}
+
+static void
+search_text_line(struct output* o, char const* line, size_t len)
+{
+    search_write_tokens(o->sink, line, len);
+}
+
+static struct renderer const search_renderer = {
+    .name = "search",
+    .begin_file = symbols_begin_file,
+    .section_header = search_section_header,
+    .text_line = search_text_line,
+    .source_line = symbols_line,
+};
+
+static struct renderer const*
+find_renderer(char const* name)
+{
+    size_t const count = sizeof(renderers) / sizeof(renderers[0]);
+    for (size_t i = 0; i < count; ++i) {
+        if (strcmp(renderers[i]->name, name) == 0) {
+            return renderers[i];
+        }
+    }
+    return NULL;
+}
+
+static void
+json_write_string(struct sink* s, char const* text, size_t size)
+{
+    static char const hex[] = "0123456789abcdef";
+    sink_write(s, "\"", 1);
+    char const* span = text;
+    char const* const end = text + size;
+    for (char const* cp = text; cp != end; ++cp) {
+        unsigned char const c = (unsigned char)*cp;
+        if (c >= 0x20 && c != '"' && c != '\\') {
             continue;
         }
-
-        bool const use_stdin = strcmp(arg, "-") == 0 && !parse_options;
-        FILE* const fp = use_stdin ? stdin : fopen(arg, "rb");
-        if (fp == NULL) {
-            perror(arg);
-            exit(EXIT_FAILURE);
+        sink_write(s, span, (size_t)(cp - span));
+        span = cp + 1;
+        if (c == '"' || c == '\\') {
+            char const escape[2] = {'\\', (char)c};
+            sink_write(s, escape, 2);
+        }
+        else if (c == '\t') {
+            sink_write(s, "\\t", 2);
+        }
+        else {
+            char const escape[6] = {
+                '\\', 'u', '0', '0', hex[c >> 4], hex[c & 0xf]};
+            sink_write(s, escape, 6);
         }
-        do_file(fp);
-        fclose(fp);
     }
-
-    return EXIT_SUCCESS;
+    sink_write(s, span, (size_t)(end - span));
+    sink_write(s, "\"", 1);
 }
 
 static void
-usage(void)
+man_write_text(struct sink* s, char const* text, size_t size)
 {
-    // clang-format off
-    puts(
-        "Usage: cdoc [OPTION]... [--] [FILE]..."                "\n"
-                                                                "\n"
-        "With no FILE, or when FILE is -, read standard input." "\n"
-                                                                "\n"
-        "Options:"                                              "\n"
-        "  --help      Display usage information and exit."     "\n"
-        "  --version   Display version information and exit."   "\n"
-        "  --md        Output in Markdown format."              "\n"
-    );
-    // clang-format on
-    exit(EXIT_SUCCESS);
+    char const* span = text;
+    char const* const end = text + size;
+    char const* cp;
+    while ((cp = memchr(span, '\\', (size_t)(end - span))) != NULL) {
+        sink_write(s, span, (size_t)(cp - span));
+        sink_write(s, "\\e", 2);
+        span = cp + 1;
+    }
+    sink_write(s, span, (size_t)(end - span));
 }
 
 static void
-version(void)
+man_write_line(struct sink* s, char const* text, size_t size)
 {
-    puts(VERSION);
-    exit(EXIT_SUCCESS);
+    if (size != 0 && (text[0] == '.' || text[0] == '\'')) {
+        sink_write(s, "\\&", 2);
+    }
+    man_write_text(s, text, size);
+    sink_write(s, "\n", 1);
 }
 
 static void
-errorf(char const* fmt, ...)
+html_write_anchor(struct sink* s, char const* name, size_t size)
 {
-    if (fmt == NULL) {
-        fputs("error: errorf called with NULL format string\n", stderr);
-        goto terminate;
+    char const* span = name;
+    char const* const end = name + size;
+    for (char const* cp = name; cp != end; ++cp) {
+        unsigned char const c = (unsigned char)*cp;
+        if ((c >= 'a' && c <= 'z') || (c >= 'A' && c <= 'Z')
+            || (c >= '0' && c <= '9') || c == '_' || c == '-' || c == '.') {
+            continue;
+        }
+        sink_write(s, span, (size_t)(cp - span));
+        sink_write(s, "_", 1);
+        span = cp + 1;
     }
-
-    va_list args;
-    va_start(args, fmt);
-    fputs("error: ", stderr);
-    vfprintf(stderr, fmt, args);
-    fputs("\n", stderr);
-    va_end(args);
-
-terminate:
-    // Any error should immediately terminate the program.
-    exit(EXIT_FAILURE);
+    sink_write(s, span, (size_t)(end - span));
 }
 
-static void*
-xalloc(void* ptr, size_t size)
+static void
+html_write_text(struct sink* s, char const* text, size_t size)
 {
-    if (size == 0) {
-        free(ptr);
-        return NULL;
+    char const* span = text;
+    char const* const end = text + size;
+    char const* cp;
+    while ((cp = html_skip_text(span, end)) != end) {
+        sink_write(s, span, (size_t)(cp - span));
+        switch (*cp) {
+        case '&':
+            sink_write(s, "&amp;", 5);
+            break;
+        case '<':
+            sink_write(s, "&lt;", 4);
+            break;
+        default:
+            sink_write(s, "&gt;", 4);
+            break;
+        }
+        span = cp + 1;
     }
-    if ((ptr = realloc(ptr, size)) == NULL) {
-        errorf("[%s] Out of memory", __func__);
+    sink_write(s, span, (size_t)(end - span));
+}
+
+static void
+html_write_line(struct sink* s, char const* text, size_t size)
+{
+    // Most lines have nothing to escape, so the line is copied to the
+    // buffer as it is examined, and the copy only counts if nothing in it
+    // needed escaping.
+    if (s->cap - s->size > size) {
+        char* const out = s->buf + s->size;
+        bool clean = true;
+        // Without SIMD, and for blank lines, braces, and other short lines,
+        // the line is copied a character at a time, which costs less than
+        // a scan followed by a copy.
+#if defined(HAVE_SSE2_SCAN)
+        bool const scalar = size < 8;
+#else
+        bool const scalar = true;
+#endif
+        if (scalar) {
+            for (size_t i = 0; i < size; ++i) {
+                char const c = text[i];
+                out[i] = c;
+                clean &= c != '&' && c != '<' && c != '>';
+            }
+        }
+#if defined(HAVE_SSE2_SCAN)
+        // The last block of a line overlaps the one before, and a line of
+        // 8 to 15 characters is loaded as two overlapping halves.
+        else if (size < 16) {
+            __m128i const a = _mm_unpacklo_epi64(
+                _mm_loadl_epi64((__m128i const*)text),
+                _mm_loadl_epi64((__m128i const*)(text + size - 8)));
+            _mm_storel_epi64((__m128i*)out, a);
+            _mm_storel_epi64(
+                (__m128i*)(out + size - 8), _mm_unpackhi_epi64(a, a));
+            clean = _mm_movemask_epi8(html_special_mask(a)) == 0;
+        }
+        else {
+            for (size_t i = 0; clean; i += 16) {
+                i = i > size - 16 ? size - 16 : i;
+                __m128i const a = _mm_loadu_si128((__m128i const*)(text + i));
+                _mm_storeu_si128((__m128i*)(out + i), a);
+                clean = _mm_movemask_epi8(html_special_mask(a)) == 0;
+                if (i == size - 16) {
+                    break;
+                }
+            }
+        }
+#endif
+        if (clean) {
+            out[size] = '\n';
+            s->size += size + 1;
+            s->total += size + 1;
+            return;
+        }
     }
-    return ptr;
+    html_write_text(s, text, size);
+    sink_write(s, "\n", 1);
 }
 
-static char*
-read_text_file(FILE* stream)
+#if defined(HAVE_SSE2_SCAN)
+static __m128i
+html_special_mask(__m128i a)
 {
-    char* buf = NULL;
-    size_t len = 0;
+    return _mm_or_si128(
+        _mm_cmpeq_epi8(a, _mm_set1_epi8('&')),
+        _mm_or_si128(
+            _mm_cmpeq_epi8(a, _mm_set1_epi8('<')),
+            _mm_cmpeq_epi8(a, _mm_set1_epi8('>'))));
+}
+#endif
 
-    int c;
-    while ((c = fgetc(stream)) != EOF) {
-        if (c == '\0') {
-            errorf("Encountered illegal NUL byte");
+static char const*
+html_skip_text(char const* cp, char const* end)
+{
+#if defined(HAVE_SSE2_SCAN)
+    if (end - cp >= 16) {
+        // A partial block at the end is loaded as the last sixteen
+        // characters, ignoring those already examined.
+        for (char const* block = cp;; block += 16) {
+            int shift = 0;
+            if (end - block < 16) {
+                shift = 16 - (int)(end - block);
+                block = end - 16;
+            }
+            __m128i const a = _mm_loadu_si128((__m128i const*)block);
+            int const mask =
+                _mm_movemask_epi8(html_special_mask(a)) >> shift << shift;
+            if (mask != 0) {
+                return block + lowest_bit((uint64_t)mask);
+            }
+            if (end - block == 16) {
+                return end;
+            }
         }
-        buf = xalloc(buf, len + 1);
-        buf[len++] = (char)c;
     }
-    if (!feof(stream)) {
-        errorf("Failed to read entire text file");
+#elif defined(HAVE_NEON_SCAN)
+    for (; end - cp >= 16; cp += 16) {
+        uint8x16_t const a = vld1q_u8((uint8_t const*)cp);
+        uint8x16_t const m = vorrq_u8(
+            vceqq_u8(a, vdupq_n_u8('&')),
+            vorrq_u8(
+                vceqq_u8(a, vdupq_n_u8('<')), vceqq_u8(a, vdupq_n_u8('>'))));
+        // Narrow each byte of the mask to four bits of a 64-bit value.
+        uint64_t const mask = vget_lane_u64(
+            vreinterpret_u64_u8(vshrn_n_u16(vreinterpretq_u16_u8(m), 4)), 0);
+        if (mask != 0) {
+            return cp + lowest_bit(mask) / 4;
+        }
     }
-
-    buf = xalloc(buf, len + 1);
-    buf[len++] = '\0';
-    return buf;
+#endif
+    while (cp != end && *cp != '&' && *cp != '<' && *cp != '>') {
+        cp += 1;
+    }
+    return cp;
 }
 
-static char**
-text_to_lines(char* text)
+static struct symtab_slot*
+symtab_intern(struct symtab* t, char const* str, size_t len)
 {
-    if (text == NULL || *text == '\0') {
-        char** lines = xalloc(NULL, sizeof(char*));
-        lines[0] = NULL;
-        return lines;
+    if (t->used + 1 > t->slot_count / 4 * 3) {
+        symtab_reserve(t, t->slot_count == 0 ? 768 : t->slot_count * 3 / 2);
     }
-    char** lines = xalloc(NULL, (strlen(text) + 1) * sizeof(char*));
-    size_t count = 0;
-    lines[count++] = text;
 
-    for (; *text; ++text) {
-        if (*text != '\n') {
-            continue;
+    uint64_t const hash = hash64(str, len, 0);
+    struct symtab_slot* const slot = symtab_probe(t, str, len, hash);
+    if (slot->offset != 0) {
+        return slot;
+    }
+    if (t->pool_size + len + 1 > UINT32_MAX - 1) {
+        errorf("[%s] Too many symbols", __func__);
+    }
+    if (t->pool_cap - t->pool_size < len + 1) {
+        while (t->pool_cap - t->pool_size < len + 1) {
+            t->pool_cap = t->pool_cap == 0 ? 64 * 1024 : t->pool_cap * 2;
         }
-        *text = '\0';
-        lines[count++] = text + 1;
+        t->pool = xalloc(t->pool, t->pool_cap);
     }
-    lines[count] = NULL;
+    memcpy(t->pool + t->pool_size, str, len);
+    t->pool[t->pool_size + len] = '\0';
+    slot->hash = hash;
+    slot->offset = (uint32_t)t->pool_size + 1;
+    slot->first = SYMBOL_NONE;
+    slot->last = SYMBOL_NONE;
+    t->pool_size += len + 1;
+    t->used += 1;
+    return slot;
+}
 
-    return lines;
+static void
+symtab_reserve(struct symtab* t, size_t count)
+{
+    size_t slot_count = 16;
+    while (slot_count / 4 * 3 < count) {
+        slot_count *= 2;
+    }
+    if (slot_count <= t->slot_count) {
+        return;
+    }
+    size_t const old_count = t->slot_count;
+    struct symtab_slot* const old = t->slots;
+    t->slot_count = slot_count;
+    t->slots = xalloc(NULL, t->slot_count * sizeof(*t->slots));
+    memset(t->slots, 0, t->slot_count * sizeof(*t->slots));
+    for (size_t i = 0; i < old_count; ++i) {
+        if (old[i].offset != 0) {
+            size_t j = (size_t)old[i].hash & (t->slot_count - 1);
+            while (t->slots[j].offset != 0) {
+                j = (j + 1) & (t->slot_count - 1);
+            }
+            t->slots[j] = old[i];
+        }
+    }
+    free(old);
 }
 
-static bool
-is_hspace(int c)
+static struct symtab_slot*
+symtab_probe(
+    struct symtab const* t, char const* str, size_t len, uint64_t hash)
 {
-    return c == '\t' || c == '\r' || c == ' ';
+    size_t const mask = t->slot_count - 1;
+    size_t i = (size_t)hash & mask;
+    for (;; i = (i + 1) & mask) {
+        struct symtab_slot* const slot = &t->slots[i];
+        if (slot->offset == 0) {
+            return slot;
+        }
+        char const* const interned = t->pool + slot->offset - 1;
+        if (slot->hash == hash && memcmp(interned, str, len) == 0
+            && interned[len] == '\0') {
+            return slot;
+        }
+    }
 }
 
-static bool
-is_doc_comment(char const* line)
+static void
+symtab_add(
+    struct symtab* t,
+    char const* name,
+    size_t name_len,
+    uint32_t tag,
+    uint32_t path,
+    uint32_t suffix)
 {
-    if (line == NULL) {
-        return false;
+    if (t->symbol_count == t->symbol_cap) {
+        t->symbol_cap = t->symbol_cap == 0 ? 1024 : t->symbol_cap * 2;
+        t->symbols = xalloc(t->symbols, t->symbol_cap * sizeof(*t->symbols));
     }
-    while (is_hspace(*line)) {
-        line += 1;
+    uint32_t const index = (uint32_t)t->symbol_count++;
+    struct symtab_slot* const slot = symtab_intern(t, name, name_len);
+    struct symbol* const sym = &t->symbols[index];
+    sym->name = slot->offset - 1;
+    sym->tag = tag;
+    sym->path = path;
+    sym->suffix = suffix;
+    sym->next = SYMBOL_NONE;
+    if (slot->first == SYMBOL_NONE) {
+        slot->first = index;
     }
-    return strncmp(line, "/*!", 3) == 0;
+    else {
+        t->symbols[slot->last].next = index;
+    }
+    slot->last = index;
 }
 
-static char*
-clean_doc_line(char* line)
+static uint32_t
+symtab_find(struct symtab const* t, char const* name, size_t len)
 {
-    char* p = line;
-    while (is_hspace(*p)) {
-        p++;
-    }
-    if (*p == '*') {
-        p++;
-        if (is_hspace(*p)) {
-            p++;
-        }
+    if (t->slot_count == 0) {
+        return SYMBOL_NONE;
     }
-    return p;
+    struct symtab_slot const* const slot =
+        symtab_probe(t, name, len, hash64(name, len, 0));
+    return slot->offset != 0 ? slot->first : SYMBOL_NONE;
 }
 
 static void
-do_file(FILE* fp)
+symtab_free(struct symtab* t)
 {
-    char* const text = read_text_file(fp);
-    char** const lines = text_to_lines(text);
-    char** linep = lines; // current line
+    free(t->pool);
+    free(t->slots);
+    free(t->symbols);
+    *t = (struct symtab){0};
+}
 
-    // PARSE
-    struct doc* docs = NULL;
-    size_t doc_count = 0;
-    while (*linep != NULL) {
-        if (!is_doc_comment(*linep)) {
-            linep += 1;
-            continue;
-        }
-        docs = xalloc(docs, (doc_count + 1) * sizeof(*docs));
-        docs[doc_count++] = parse_doc(lines, &linep);
+/*!
+ * @struct index_entry
+ * A symbol of the index along with its name, as sorted by render_index.
+ */
+struct index_entry
+{
+    char const* name;
+    uint32_t symbol;
+};
+
+static int
+compare_index_entries(void const* lhs, void const* rhs)
+{
+    struct index_entry const* const a = lhs;
+    struct index_entry const* const b = rhs;
+    int const order = strcmp(a->name, b->name);
+    if (order != 0) {
+        return order;
     }
+    return a->symbol < b->symbol ? -1 : a->symbol > b->symbol;
+}
 
-    // PRINT
-    for (size_t i = 0; i < doc_count; ++i) {
-        print_doc(docs[i]);
+static void
+render_index(
+    struct options const* options,
+    char const* data,
+    size_t size,
+    struct sink* out)
+{
+    // Every definition is added before any reference is resolved, so that
+    // a reference may name a doc of a later file.
+    struct symtab t = {0};
+    char const* const end = data + size;
+    // The @see links of a page per file only reach the docs of that file.
+    bool paged = false;
+    for (size_t i = 0; i < options->target_count; ++i) {
+        paged |= options->targets[i].per_file
+            && strcmp(options->targets[i].renderer->name, "html") == 0;
+    }
+    for (int pass = 0; pass < 2; ++pass) {
+        char const* path = "";
+        uint32_t path_offset = 0;
+        char const* p = data;
+        while (p != end) {
+            char const kind = *p++;
+            char const* const field = p;
+            char const* const field_end = memchr(p, '\0', (size_t)(end - p));
+            if (field_end == NULL) {
+                break;
+            }
+            p = field_end + 1;
+            if (kind == 'F') {
+                path = field;
+                size_t const len = (size_t)(field_end - field);
+                path_offset = symtab_intern(&t, field, len)->offset - 1;
+            }
+            else if (kind == 'D') {
+                char const* const name = p;
+                char const* const name_end =
+                    memchr(p, '\0', (size_t)(end - p));
+                if (name_end == NULL) {
+                    break;
+                }
+                char const* const suffix = name_end + 1;
+                char const* const suffix_end =
+                    memchr(suffix, '\0', (size_t)(end - suffix));
+                if (suffix_end == NULL) {
+                    break;
+                }
+                p = suffix_end + 1;
+                if (pass == 0) {
+                    size_t const len = (size_t)(field_end - field);
+                    uint32_t const tag = symtab_intern(&t, field, len)->offset;
+                    uint32_t const suffix_offset =
+                        symtab_intern(
+                            &t, suffix, (size_t)(suffix_end - suffix))->offset;
+                    symtab_add(
+                        &t,
+                        name,
+                        (size_t)(name_end - name),
+                        tag - 1,
+                        path_offset,
+                        suffix_offset - 1);
+                }
+            }
+            else if (kind == 'R' && pass == 1) {
+                size_t const len = (size_t)(field_end - field);
+                uint32_t const first = symtab_find(&t, field, len);
+                uint32_t sym = first;
+                while (paged && sym != SYMBOL_NONE
+                    && t.symbols[sym].path != path_offset) {
+                    sym = t.symbols[sym].next;
+                }
+                if (first == SYMBOL_NONE) {
+                    fprintf(
+                        stderr,
+                        "warning: %s: Unresolved reference to '%s'\n",
+                        path,
+                        field);
+                }
+                else if (paged && sym == SYMBOL_NONE) {
+                    fprintf(
+                        stderr,
+                        "warning: %s: Reference to '%s' is not linked to "
+                        "the page of %s\n",
+                        path,
+                        field,
+                        t.pool + t.symbols[first].path);
+                }
+            }
+        }
     }
 
-    // CLEANUP
-    for (size_t i = 0; i < doc_count; ++i) {
-        free(docs[i].sections);
-        free(docs[i].source);
+    struct index_entry* const entries =
+        xalloc(NULL, t.symbol_count * sizeof(*entries));
+    for (size_t i = 0; i < t.symbol_count; ++i) {
+        entries[i].name = t.pool + t.symbols[i].name;
+        entries[i].symbol = (uint32_t)i;
     }
-    free(docs);
-    free(text);
-    free(lines);
+    if (t.symbol_count > 1) {
+        qsort(entries, t.symbol_count, sizeof(*entries), compare_index_entries);
+    }
+    SINK_LITERAL(out, "<h2>Index</h2>\n<ul>\n");
+    for (size_t i = 0; i < t.symbol_count; ++i) {
+        struct symbol const* const sym = &t.symbols[entries[i].symbol];
+        char const* const name = entries[i].name;
+        char* const href =
+            page_href(options, options->index_path, t.pool + sym->path);
+        SINK_LITERAL(out, "<li>");
+        if (href != NULL) {
+            SINK_LITERAL(out, "<a href=\"");
+            sink_puts(out, href);
+            sink_write(out, "#", 1);
+            html_write_anchor(out, name, strlen(name));
+            sink_puts(out, t.pool + sym->suffix);
+            SINK_LITERAL(out, "\">");
+        }
+        html_write_text(out, name, strlen(name));
+        if (href != NULL) {
+            SINK_LITERAL(out, "</a>");
+        }
+        SINK_LITERAL(out, " (");
+        html_write_text(out, t.pool + sym->tag, strlen(t.pool + sym->tag));
+        SINK_LITERAL(out, ", ");
+        html_write_text(out, t.pool + sym->path, strlen(t.pool + sym->path));
+        SINK_LITERAL(out, ")</li>\n");
+        free(href);
+    }
+    SINK_LITERAL(out, "</ul>\n");
+
+    free(entries);
+    symtab_free(&t);
 }
 
-static char**
-parse_struct_source(char*** linepp)
+static char*
+page_href(struct options const* options, char const* from, char const* path)
 {
-    char** lines = NULL;
-    size_t count = 0;
-
-    bool parsed = false; // Are we finished parsing the source?
-    int brackets = 0; // Number of '{' minus number of '}'.
-    for (; **linepp && !parsed; *linepp += 1) {
-        lines = xalloc(lines, (count + 1) * sizeof(char*));
-        lines[count++] = **linepp;
-
-        for (char* cp = **linepp; *cp != '\0'; ++cp) {
-            brackets += *cp == '{';
-            brackets -= *cp == '}';
-            if (brackets == 0 && *cp == ';') {
-                parsed = true;
-            }
+    // A target writing a page per file links to the page of path.
+    for (size_t i = 0; i < options->target_count; ++i) {
+        struct target const* const target = &options->targets[i];
+        if (strcmp(target->renderer->name, "html") != 0) {
+            continue;
+        }
+        if (target->per_file) {
+            char* const page =
+                output_file_path(options, path, target->renderer);
+            char* const href = relative_path(from, page);
+            free(page);
+            return href;
+        }
+        if (target->path != NULL && strcmp(target->path, "-") != 0) {
+            return relative_path(from, target->path);
         }
     }
-
-    lines = xalloc(lines, (count + 1) * sizeof(char*));
-    lines[count] = NULL;
-    return lines;
+    return NULL;
 }
 
-static char**
-parse_function_source(char*** linepp)
+static void
+render_search_index(
+    struct options const* options,
+    char const* data,
+    size_t size,
+    struct sink* out)
 {
-    char** lines = NULL;
-    size_t count = 0;
+    struct sink files;
+    struct sink docs;
+    sink_init_memory(&files);
+    sink_init_memory(&docs);
+    size_t file_count = 0;
+    size_t doc_count = 0;
 
-    bool parsed = false;
-    for (; **linepp && !parsed; *linepp += 1) {
-        lines = xalloc(lines, (count + 1) * sizeof(char*));
-        lines[count++] = **linepp;
+    // Tokens are numbered as they are first seen, and each token is
+    // recorded once per doc by remembering the last doc it occurred in.
+    struct symtab t = {0};
+    struct index_entry* tokens = NULL;
+    size_t token_count = 0;
+    size_t token_cap = 0;
+    struct search_posting* postings = NULL;
+    size_t posting_count = 0;
+    size_t posting_cap = 0;
 
-        for (char* cp = **linepp; *cp != '\0'; ++cp) {
-            if (*cp == ';') {
-                parsed = true;
+    char const* const end = data + size;
+    char const* p = data;
+    while (p != end) {
+        char const kind = *p++;
+        char const* const field = p;
+        char const* const field_end = memchr(p, '\0', (size_t)(end - p));
+        if (field_end == NULL) {
+            break;
+        }
+        size_t const len = (size_t)(field_end - field);
+        p = field_end + 1;
+        if (kind == 'F') {
+            char* const href = page_href(options, options->search_index, field);
+            sink_write_varint(&files, len);
+            sink_write(&files, field, len);
+            if (href != NULL) {
+                sink_write_varint(&files, strlen(href));
+                sink_puts(&files, href);
+            }
+            else {
+                sink_write_varint(&files, 0);
+            }
+            free(href);
+            file_count += 1;
+        }
+        else if (kind == 'D') {
+            char const* const name = p;
+            char const* const name_end = memchr(p, '\0', (size_t)(end - p));
+            if (name_end == NULL) {
                 break;
             }
-            else if (*cp == '{') {
-                parsed = true;
-                lines = xalloc(lines, (count + 1) * sizeof(char*));
-                lines[count++] = "/* function definition... */";
+            size_t const name_len = (size_t)(name_end - name);
+            char const* const suffix = name_end + 1;
+            char const* const suffix_end =
+                memchr(suffix, '\0', (size_t)(end - suffix));
+            if (suffix_end == NULL) {
+                break;
             }
-            if (*cp == '{' || *cp == ';') {
-                parsed = true;
+            p = suffix_end + 1;
+            if (doc_count == UINT32_MAX - 1) {
+                errorf("[%s] Too many docs", __func__);
+            }
+            // The anchor is that of the first section in the HTML output.
+            struct sink anchor;
+            sink_init_memory(&anchor);
+            if (name_len != 0) {
+                html_write_anchor(&anchor, name, name_len);
+            }
+            else {
+                html_write_anchor(&anchor, field, len);
+            }
+            sink_write(&anchor, suffix, (size_t)(suffix_end - suffix));
+            sink_write_varint(&docs, file_count - 1);
+            sink_write_varint(&docs, len);
+            sink_write(&docs, field, len);
+            sink_write_varint(&docs, name_len);
+            sink_write(&docs, name, name_len);
+            sink_write_varint(&docs, anchor.size);
+            sink_write(&docs, anchor.buf, anchor.size);
+            sink_free(&anchor);
+            doc_count += 1;
+        }
+        else if (kind == 'T' && doc_count != 0) {
+            uint32_t const doc = (uint32_t)doc_count - 1;
+            struct symtab_slot* const slot = symtab_intern(&t, field, len);
+            if (slot->first == SYMBOL_NONE) {
+                if (token_count == token_cap) {
+                    token_cap = token_cap == 0 ? 1024 : token_cap * 2;
+                    tokens = xalloc(tokens, token_cap * sizeof(*tokens));
+                }
+                slot->first = (uint32_t)token_count;
+                tokens[token_count].symbol = slot->offset - 1;
+                token_count += 1;
+            }
+            else if (slot->last == doc) {
+                continue;
             }
+            slot->last = doc;
+            if (posting_count == posting_cap) {
+                posting_cap = posting_cap == 0 ? 4096 : posting_cap * 2;
+                postings =
+                    xalloc(postings, posting_cap * sizeof(*postings));
+            }
+            postings[posting_count].token = slot->first;
+            postings[posting_count].doc = doc;
+            posting_count += 1;
         }
     }
 
-    lines = xalloc(lines, (count + 1) * sizeof(char*));
-    lines[count] = NULL;
-    return lines;
-}
+    // Sort the tokens by name, then order the postings by the rank of their
+    // token; placing them in the order of the docs keeps each list sorted.
+    for (size_t i = 0; i < token_count; ++i) {
+        tokens[i].name = t.pool + tokens[i].symbol;
+        tokens[i].symbol = (uint32_t)i;
+    }
+    if (token_count > 1) {
+        qsort(tokens, token_count, sizeof(*tokens), compare_index_entries);
+    }
+    uint32_t* const rank = xalloc(NULL, (token_count + 1) * sizeof(*rank));
+    size_t* const starts = xalloc(NULL, (token_count + 1) * sizeof(*starts));
+    for (size_t i = 0; i < token_count; ++i) {
+        rank[tokens[i].symbol] = (uint32_t)i;
+        starts[i + 1] = 0;
+    }
+    starts[0] = 0;
+    for (size_t i = 0; i < posting_count; ++i) {
+        starts[rank[postings[i].token] + 1] += 1;
+    }
+    for (size_t i = 0; i < token_count; ++i) {
+        starts[i + 1] += starts[i];
+    }
+    uint32_t* const sorted =
+        xalloc(NULL, (posting_count + 1) * sizeof(*sorted));
+    for (size_t i = 0; i < posting_count; ++i) {
+        sorted[starts[rank[postings[i].token]]++] = postings[i].doc;
+    }
 
-static char**
-parse_macro_source(char*** linepp)
-{
-    char** lines = NULL;
-    size_t count = 0;
+    sink_write(out, SEARCH_MAGIC, sizeof(SEARCH_MAGIC));
+    sink_write_varint(out, file_count);
+    sink_write(out, files.buf, files.size);
+    sink_write_varint(out, doc_count);
+    sink_write(out, docs.buf, docs.size);
+    sink_write_varint(out, token_count);
+    // Each token shares a prefix with the previous one in sorted order, and
+    // each list counts its docs from the previous doc of the list.
+    char const* previous = "";
+    for (size_t i = 0, pos = 0; i < token_count; ++i) {
+        char const* const name = tokens[i].name;
+        size_t shared = 0;
+        while (name[shared] != '\0' && name[shared] == previous[shared]) {
+            shared += 1;
+        }
+        size_t const len = strlen(name + shared);
+        sink_write_varint(out, shared);
+        sink_write_varint(out, len);
+        sink_write(out, name + shared, len);
+        previous = name;
 
-    bool parsed = false;
-    for (; **linepp && !parsed; *linepp += 1) {
-        lines = xalloc(lines, (count + 1) * sizeof(char*));
-        lines[count++] = **linepp;
-        parsed = (**linepp)[strlen(**linepp) - 1] != '\\';
+        size_t const count = starts[i] - pos;
+        sink_write_varint(out, count);
+        uint32_t last = 0;
+        for (size_t j = 0; j < count; ++j) {
+            uint32_t const doc = sorted[pos + j];
+            sink_write_varint(out, doc - last);
+            last = doc;
+        }
+        pos += count;
     }
 
-    lines = xalloc(lines, (count + 1) * sizeof(char*));
-    lines[count] = NULL;
-    return lines;
+    free(sorted);
+    free(starts);
+    free(rank);
+    free(postings);
+    free(tokens);
+    symtab_free(&t);
+    sink_free(&docs);
+    sink_free(&files);
 }
 
-static struct doc
-parse_doc(char* const* lines_begin, char*** linepp)
+static char*
+relative_path(char const* from, char const* to)
 {
-    struct doc d = {0};
-
-    // Collect all lines within the doc comment block.
-    char** block_lines = NULL;
-    size_t block_line_count = 0;
-    bool in_comment = true;
-
-    char* first_line = **linepp;
-    char* start = strstr(first_line, "/*!");
-    if (!start) errorf("Internal error: parse_doc called on non-doc line.");
-    
-    char* content = start + 3; // Move past "/*!".
-    char* end = strstr(content, "*/");
-    if (end) {
-        *end = '\0';
-        in_comment = false;
-    }
-    
-    block_lines = xalloc(block_lines, (block_line_count + 1) * sizeof(*block_lines));
-    block_lines[block_line_count++] = content;
-
-    if (in_comment) {
-        *linepp += 1;
-        for (; **linepp; *linepp += 1) {
-            char* current_line = **linepp;
-            end = strstr(current_line, "*/");
-            if (end) {
-                *end = '\0';
-                in_comment = false;
-            }
-            block_lines = xalloc(block_lines, (block_line_count + 1) * sizeof(*block_lines));
-            block_lines[block_line_count++] = current_line;
-            if (!end) continue;
-            break;
+    char* from_path = canonical_path(from, NULL);
+    char* to_path = canonical_path(to, NULL);
+    bool const up = strncmp(from_path, "..", 2) == 0
+        && (from_path[2] == '/' || from_path[2] == '\0');
+    if (from_path[0] == '/' || to_path[0] == '/' || up) {
+        char* const cwd = realpath(".", NULL);
+        if (cwd == NULL) {
+            free(from_path);
+            return to_path;
         }
+        free(from_path);
+        free(to_path);
+        from_path = canonical_path(from, cwd);
+        to_path = canonical_path(to, cwd);
+        free(cwd);
     }
-    
-    *linepp += 1; // Consume the line with the end of the comment.
-
-    // NULL-terminate the block lines array.
-    block_lines = xalloc(block_lines, (block_line_count + 1) * sizeof(*block_lines));
-    block_lines[block_line_count] = NULL;
 
-    // Parse the collected lines into sections.
-    char** current_line_p = block_lines;
-    while(current_line_p && *current_line_p) { // Check added for safety
-        char* cleaned_line = clean_doc_line(*current_line_p);
-        if (*cleaned_line == '@') {
-             d.sections = xalloc(d.sections, (d.section_count + 1) * sizeof(*d.sections));
-             d.sections[d.section_count++] = parse_section(lines_begin, cleaned_line, &current_line_p);
-        } else {
-             current_line_p++; // Skip empty lines between sections
+    // Skip the directories shared by both paths.
+    size_t common = 0;
+    for (size_t i = 0; from_path[i] != '\0' && from_path[i] == to_path[i];
+         ++i) {
+        if (from_path[i] == '/') {
+            common = i + 1;
         }
     }
-    // Duplicate an array of text‐line pointers for a section body so that
-    // they remain valid after freeing the temporary block_lines buffer.
-    for (size_t i = 0; i < d.section_count; ++i) {
-        struct section* s = &d.sections[i];
-        if (s->text_len > 0) {
-            char** new_text = xalloc(NULL, (s->text_len + 1) * sizeof(char*));
-            for (int j = 0; j < s->text_len; ++j) {
-                new_text[j] = s->text_start[j];
-            }
-            new_text[s->text_len] = NULL;
-            s->text_start = new_text;
-        }
+    size_t ups = 0;
+    for (char const* cp = from_path + common; *cp != '\0'; ++cp) {
+        ups += *cp == '/';
     }
-    
-    free(block_lines);
 
-    if (d.section_count == 0) return d;
+    size_t const to_len = strlen(to_path);
+    char* const path = xalloc(NULL, ups * 3 + to_len - common + 1);
+    for (size_t i = 0; i < ups; ++i) {
+        memcpy(path + i * 3, "../", 3);
+    }
+    memcpy(path + ups * 3, to_path + common, to_len - common + 1);
+    free(from_path);
+    free(to_path);
+    return path;
+}
 
-    // Parse associated source code.
-    char const* const tag_start = d.sections[0].tag_start;
-    size_t const len = (size_t)d.sections[0].tag_len;
-#define DOC_IS(tag) (len == strlen(tag) && strncmp(tag_start, tag, len) == 0)
-    if (DOC_IS("struct") || DOC_IS("union") || DOC_IS("enum")
-        || DOC_IS("typedef") || DOC_IS("variable")) {
-        d.source = parse_struct_source(linepp);
+static char*
+canonical_path(char const* path, char const* cwd)
+{
+    if (path[0] == '/') {
+        cwd = NULL;
     }
-    else if (DOC_IS("function")) {
-        d.source = parse_function_source(linepp);
+    size_t const cwd_len = cwd != NULL ? strlen(cwd) : 0;
+    char* const out = xalloc(NULL, cwd_len + strlen(path) + 2);
+    size_t len = 0;
+    // No ".." removes the root of an absolute path.
+    size_t root = 0;
+    if (path[0] == '/' || cwd != NULL) {
+        out[len++] = '/';
+        root = 1;
     }
-    else if (DOC_IS("macro")) {
-        d.source = parse_macro_source(linepp);
+    char const* const parts[] = {cwd != NULL ? cwd : "", path};
+    for (size_t p = 0; p < 2; ++p) {
+        for (char const* cp = parts[p]; *cp != '\0';) {
+            size_t const n = strcspn(cp, "/");
+            bool const dots = n == 2 && cp[0] == '.' && cp[1] == '.';
+            // Only a relative path may start with "..", and the last
+            // component is removed by a ".." unless it is one itself.
+            bool const last_dots = len >= root + 2
+                && memcmp(out + len - 2, "..", 2) == 0
+                && (len == root + 2 || out[len - 3] == '/');
+            if (n == 0 || (n == 1 && cp[0] == '.')) {
+                // Names the same directory.
+            }
+            else if (dots && len > root && !last_dots) {
+                while (len > root && out[len - 1] != '/') {
+                    len -= 1;
+                }
+                len -= len > root;
+            }
+            else if (!(dots && root != 0)) {
+                if (len > root) {
+                    out[len++] = '/';
+                }
+                memcpy(out + len, cp, n);
+                len += n;
+            }
+            cp += n + (cp[n] == '/');
+        }
     }
-#undef DOC_IS
-
-    return d;
+    out[len] = '\0';
+    return out;
 }
 
 static void
-print_doc(struct doc const d)
+write_ir(
+    char const* path, char const* data, size_t size, struct walk const* walk)
 {
-    for (size_t i = 0; i < d.section_count; ++i) {
-        print_section(d.sections[i]);
+    struct ir_header header = {0};
+    memcpy(header.magic, IR_MAGIC, sizeof(IR_MAGIC));
+    header.section_size = sizeof(struct section);
+    header.doc_size = sizeof(struct ir_doc);
+    header.shard = (uint32_t)walk->shard;
+    header.shard_count = (uint32_t)walk->shard_count;
+    for (size_t pos = 0; pos < size; header.file_count += 1) {
+        struct ir_chunk const* const chunk = (void const*)(data + pos);
+        pos += chunk->size;
     }
-    if (d.source != NULL) {
-        if (markdown_output) {
-            puts("```c");
-        } else {
-            puts("<pre><code>");
-        }
-        for (char** ln = d.source; *ln != NULL; ++ln) {
-            if (!is_doc_comment(*ln)) {
-                puts(*ln);
-            }
-        }
-        if (markdown_output) {
-            puts("```");
-        } else {
-            puts("</code></pre>");
+
+    uint64_t* const offsets =
+        xalloc(NULL, (header.file_count * 2 + 1) * sizeof(*offsets));
+    uint64_t* const positions = offsets + header.file_count;
+    uint64_t offset =
+        sizeof(header) + header.file_count * 2 * sizeof(*offsets);
+    // A file that failed to be read has no chunk, so the entry of each chunk
+    // is found by its path.
+    size_t entry = 0;
+    for (size_t i = 0, pos = 0; i < header.file_count; ++i) {
+        char const* const chunk = data + pos;
+        struct ir_chunk const* const c = (void const*)chunk;
+        while (entry + 1 < walk->file_count
+               && strcmp(walk->yielded[entry]->path, chunk + c->path) != 0) {
+            entry += 1;
         }
+        offsets[i] = offset;
+        positions[i] = walk->yielded[entry++]->position;
+        offset += c->size;
+        pos += c->size;
     }
-    if (markdown_output) {
-        puts("\n---");
-    } else {
-        puts("<hr>");
+
+    struct iovec parts[3];
+    parts[0].iov_base = &header;
+    parts[0].iov_len = sizeof(header);
+    parts[1].iov_base = offsets;
+    parts[1].iov_len = header.file_count * 2 * sizeof(*offsets);
+    parts[2].iov_base = (void*)data;
+    parts[2].iov_len = size;
+    mode_t const mask = umask(0);
+    umask(mask);
+    int const error = replace_file(path, parts, 3, 0666 & ~mask);
+    if (error != 0) {
+        errorf("Failed to write %s: %s", path, strerror(error));
     }
+    free(offsets);
 }
 
-static struct section
-parse_section(char* const* lines_begin, char* line, char*** text_body_p)
+static size_t
+run_ir(struct options const* options, struct sink* outs, struct stats* totals)
 {
-    struct section s = {0};
-    char* cp = line;
+    size_t const ir_count = options->from_ir_count;
+    struct text* const irs = xalloc(NULL, ir_count * sizeof(*irs));
+    struct ir_file* files = NULL;
+    size_t file_count = 0;
+    bool sharded = true;
+    uint32_t shard_count = 0;
+    uint8_t* shards_seen = NULL; // Bit per shard, once shard_count is known.
+    // Every chunk of every file is validated before anything is rendered,
+    // so that a corrupt file produces no output at all.
+    for (size_t n = 0; n < ir_count; ++n) {
+        char const* const path = options->from_ir[n];
+        int const fd = open(path, O_RDONLY);
+        if (fd < 0) {
+            errorf("%s: %s", path, strerror(errno));
+        }
+        struct text* const ir = &irs[n];
+        if (!map_text_file(fd, ir)) {
+            errorf("%s: Not an IR file", path);
+        }
+        close(fd);
 
-    if (*cp++ != '@') {
-        errorf(
-            "[line %d] Doc-section must begin with @<TAG>",
-            LINENO(lines_begin, *text_body_p));
+        struct ir_header header;
+        if (ir->size < sizeof(header)) {
+            errorf("%s: Not an IR file", path);
+        }
+        memcpy(&header, ir->data, sizeof(header));
+        if (memcmp(header.magic, IR_MAGIC, sizeof(IR_MAGIC)) != 0
+            || header.section_size != sizeof(struct section)
+            || header.doc_size != sizeof(struct ir_doc)) {
+            errorf("%s: Not an IR file of this version of cdoc", path);
+        }
+        uint64_t const* const offsets =
+            (void const*)(ir->data + sizeof(header));
+        if (header.file_count
+            > (ir->size - sizeof(header)) / sizeof(*offsets) / 2) {
+            errorf("%s: Corrupt IR file", path);
+        }
+        uint64_t const* const positions = offsets + header.file_count;
+        files = xalloc(
+            files, (file_count + header.file_count) * sizeof(*files));
+        for (size_t i = 0; i < header.file_count; ++i) {
+            uint64_t const offset = offsets[i];
+            if (offset % IR_ALIGN != 0 || offset > ir->size
+                || !ir_chunk_is_valid(
+                    ir->data + offset, ir->size - (size_t)offset)) {
+                errorf("%s: Corrupt IR file", path);
+            }
+            struct ir_file* const file = &files[file_count++];
+            file->position = positions[i];
+            file->ir = n;
+            file->chunk = ir->data + offset;
+        }
+
+        if (header.shard_count == 0) {
+            sharded = false;
+            continue;
+        }
+        if (header.shard >= header.shard_count
+            || header.shard_count > MAX_SHARD_COUNT
+            || (shard_count != 0 && header.shard_count != shard_count)) {
+            errorf("%s: Not a shard of the same run", path);
+        }
+        if (shards_seen == NULL) {
+            shard_count = header.shard_count;
+            shards_seen = xalloc(NULL, (shard_count + 7) / 8);
+            memset(shards_seen, 0, (shard_count + 7) / 8);
+        }
+        uint8_t const bit = (uint8_t)(1u << header.shard % 8);
+        if ((shards_seen[header.shard / 8] & bit) != 0) {
+            errorf(
+                "%s: Shard %" PRIu32 "/%" PRIu32 " is given twice",
+                path,
+                header.shard + 1,
+                header.shard_count);
+        }
+        shards_seen[header.shard / 8] |= bit;
     }
-    if (is_hspace(*cp) || *cp == '\0') {
-        errorf("[line %d] Empty doc-comment tag", LINENO(lines_begin, *text_body_p));
+    if (sharded) {
+        // Merging only part of a run would silently leave out every file
+        // of the missing shards.
+        for (uint32_t k = 0; k < shard_count; ++k) {
+            if ((shards_seen[k / 8] & 1u << k % 8) == 0) {
+                errorf(
+                    "Shard %" PRIu32 "/%" PRIu32 " is missing",
+                    k + 1,
+                    shard_count);
+            }
+        }
+        qsort(files, file_count, sizeof(*files), compare_ir_files);
     }
+    free(shards_seen);
 
-    // TAG
-    s.tag_start = cp;
-    while (!is_hspace(*cp) && (*cp != '\0')) {
-        cp += 1;
+    struct arena arena = {0};
+    struct symtab pages = {0};
+    for (size_t i = 0; i < file_count; ++i) {
+        char const* const chunk = files[i].chunk;
+        struct job job = {0};
+        job.options = options;
+        job.path = chunk + ((struct ir_chunk const*)(void const*)chunk)->path;
+        job.outs = outs;
+        job.arena = &arena;
+        if (!claim_page(&pages, &job)) {
+            finish_job(&job, outs, totals);
+            continue;
+        }
+        uint64_t output_bytes = 0;
+        for (size_t t = 0; t < options->target_count; ++t) {
+            output_bytes -= outs[t].total;
+        }
+        double start = options->stats ? clock_seconds() : 0;
+        render_ir_chunk(&job, chunk);
+        lap(&job, &job.stats.render, &start);
+        for (size_t t = 0; t < options->target_count; ++t) {
+            output_bytes += outs[t].total;
+        }
+        job.stats.files = 1;
+        job.stats.output_bytes = output_bytes;
+        if (options->output_dir != NULL) {
+            write_file_outputs(&job);
+        }
+        finish_job(&job, outs, totals);
     }
-    s.tag_len = (int)(cp - s.tag_start);
-
-    while (is_hspace(*cp)) {
-        cp += 1;
+    symtab_free(&pages);
+    arena_free(&arena);
+    free(files);
+    for (size_t n = 0; n < ir_count; ++n) {
+        free_text(irs[n]);
     }
+    free(irs);
+    return file_count;
+}
 
-    // NAME
-    s.name_start = cp;
-    while (!is_hspace(*cp) && (*cp != '\0')) {
-        cp += 1;
+static int
+compare_ir_files(void const* lhs, void const* rhs)
+{
+    struct ir_file const* const a = lhs;
+    struct ir_file const* const b = rhs;
+    if (a->position != b->position) {
+        return a->position < b->position ? -1 : 1;
     }
-    s.name_len = (int)(cp - s.name_start);
+    return (a->ir > b->ir) - (a->ir < b->ir);
+}
 
-    while (is_hspace(*cp)) {
-        cp += 1;
+static bool
+ir_chunk_is_valid(char const* chunk, size_t size)
+{
+    struct ir_chunk c;
+    if (size < sizeof(c)) {
+        return false;
     }
-    if (*cp != '\0') {
-        errorf(
-            "[line %d] Extra character(s) after tag line <NAME>",
-            LINENO(lines_begin, *text_body_p));
+    memcpy(&c, chunk, sizeof(c));
+    if (c.size < sizeof(c) || c.size > size || c.size % IR_ALIGN != 0) {
+        return false;
     }
-
-    // TEXT
-    *text_body_p += 1;
-    s.text_start = *text_body_p;
-    while(**text_body_p) {
-        char* peek = clean_doc_line(**text_body_p);
-        if (*peek == '@') break;
-        *text_body_p += 1;
+    // Arrays must be aligned for their elements and lie within the chunk,
+    // computed in 64 bits so that no count can wrap around.
+    uint64_t const end = c.size;
+    if (c.lines % sizeof(uint32_t) != 0 || c.docs % sizeof(uint32_t) != 0
+        || c.sections % sizeof(uint32_t) != 0
+        || c.lines + ((uint64_t)c.line_count + 1) * sizeof(uint32_t) > end
+        || c.docs + (uint64_t)c.doc_count * sizeof(struct ir_doc) > end
+        || c.sections + (uint64_t)c.section_count * sizeof(struct section)
+               > end
+        || (uint64_t)c.text + c.text_size > end || c.path >= end
+        || memchr(chunk + c.path, '\0', end - c.path) == NULL) {
+        return false;
     }
-    s.text_len = (int)(*text_body_p - s.text_start);
 
-    return s;
+    // Every line ends with a newline, so line offsets strictly increase.
+    uint32_t const* const lines = (void const*)(chunk + c.lines);
+    if (lines[0] != 0 || lines[c.line_count] > c.text_size) {
+        return false;
+    }
+    for (uint32_t i = 0; i < c.line_count; ++i) {
+        if (lines[i] >= lines[i + 1]) {
+            return false;
+        }
+    }
+    struct ir_doc const* const docs = (void const*)(chunk + c.docs);
+    for (uint32_t i = 0; i < c.doc_count; ++i) {
+        struct ir_doc const* const d = &docs[i];
+        if ((uint64_t)d->section_first + d->section_count > c.section_count
+            || (uint64_t)d->source_start + d->source_len > c.line_count
+            || (d->flags & ~(IR_HAS_SOURCE | IR_SOURCE_ELIDED)) != 0) {
+            return false;
+        }
+    }
+    struct section const* const sections = (void const*)(chunk + c.sections);
+    for (uint32_t i = 0; i < c.section_count; ++i) {
+        struct section const* const s = &sections[i];
+        if ((uint64_t)s->tag_start + s->tag_len > c.text_size
+            || (uint64_t)s->name_start + s->name_len > c.text_size
+            || (uint64_t)s->text_start + s->text_len > c.line_count
+            || s->text_end > c.text_size || (unsigned)s->tag > TAG_SEE) {
+            return false;
+        }
+        // Text lines are truncated at text_end, which must not precede the
+        // start of the last of them.
+        if (s->text_len != 0
+            && lines[s->text_start + s->text_len - 1] > s->text_end) {
+            return false;
+        }
+    }
+    return true;
 }
 
 static void
-print_section(struct section const s)
+render_ir_chunk(struct job* job, char const* chunk)
 {
-    if (markdown_output) {
-        printf(
-            "### %.*s: %.*s\n",
-            s.tag_len,
-            s.tag_start,
-            s.name_len,
-            s.name_start);
-    } else {
-        printf(
-            "<h3>%.*s: %.*s</h3>\n",
-            s.tag_len,
-            s.tag_start,
-            s.name_len,
-            s.name_start);
+    struct ir_chunk const* const c = (void const*)chunk;
+    struct file f = {0};
+    f.text = chunk + c->text;
+    // The lines are never written through f, so the mapping stays
+    // read-only.
+    f.lines = (uint32_t*)(chunk + c->lines);
+    f.line_count = c->line_count;
+    struct ir_doc const* const docs = (void const*)(chunk + c->docs);
+    struct section* const sections = (struct section*)(chunk + c->sections);
+
+    size_t const target_count = job->options->target_count;
+    struct output* const outputs =
+        xalloc(NULL, target_count * sizeof(*outputs));
+    for (size_t t = 0; t < target_count; ++t) {
+        outputs[t] = (struct output){0};
+        outputs[t].renderer = job->options->targets[t].renderer;
+        outputs[t].sink = &job->outs[t];
+        if (outputs[t].renderer->begin_file != NULL) {
+            outputs[t].renderer->begin_file(&outputs[t], job->path);
+        }
+    }
+    struct symtab names = {0};
+    symtab_reserve(&names, c->doc_count);
+    for (uint32_t i = 0; i < c->doc_count; ++i) {
+        struct doc d = {0};
+        d.sections = sections + docs[i].section_first;
+        d.section_count = docs[i].section_count;
+        d.has_source = (docs[i].flags & IR_HAS_SOURCE) != 0;
+        d.source_elided = (docs[i].flags & IR_SOURCE_ELIDED) != 0;
+        d.source_start = docs[i].source_start;
+        d.source_len = docs[i].source_len;
+        if (!doc_is_selected(job, &f, &d)) {
+            continue;
+        }
+        job->stats.docs += 1;
+        job->stats.sections += d.section_count;
+        job->stats.source_lines += d.source_len;
+        uint32_t const ordinal = count_doc(&names, &f, &d);
+        for (size_t t = 0; t < target_count; ++t) {
+            outputs[t].doc_ordinal = ordinal;
+            print_doc(&outputs[t], &f, &d);
+        }
     }
-    for (int i = 0; i < s.text_len; ++i) {
-        puts(clean_doc_line(s.text_start[i]));
+    for (size_t t = 0; t < target_count; ++t) {
+        if (outputs[t].renderer->end_file != NULL) {
+            outputs[t].renderer->end_file(&outputs[t]);
+        }
     }
+    symtab_free(&names);
+    job->stats.bytes += c->size;
+    job->stats.lines += c->line_count;
+    arena_reset(job->arena);
+    free(outputs);
 }
+#endif
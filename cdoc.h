@@ -0,0 +1,198 @@
+/*!
+ * @file cdoc.h
+ * Interface of libcdoc, the parser of the cdoc program, for embedding in
+ * build systems and editors that parse many files without forking cdoc.
+ * @license 0BSD
+ */
+
+#ifndef CDOC_H
+#define CDOC_H
+
+#include <stddef.h>
+
+/*!
+ * @struct cdoc_ctx
+ * Parser context owning the options that select docs, the memory in which
+ * docs are parsed, and the errors of the last call to cdoc_parse.
+ * The memory of a context is reused by each call, so parsing many buffers
+ * with one context allocates only when a buffer needs more than any before
+ * it.
+ * A context may be used by one thread at a time, and contexts share no
+ * state, so each thread may parse with a context of its own.
+ */
+struct cdoc_ctx;
+
+/*!
+ * @struct cdoc_line
+ * A line of a doc, without its newline character.
+ */
+struct cdoc_line
+{
+    /*! @member text
+     * First character of the line, which is not NUL-terminated.
+     */
+    char const* text;
+    /*! @member len
+     * Length of text in bytes.
+     */
+    size_t len;
+};
+
+/*!
+ * @struct cdoc_section
+ * One section of a doc: its tag, optional name, and optional body of
+ * text lines.
+ */
+struct cdoc_section
+{
+    /*! @member tag
+     * Tag of the section without its '@', which is not NUL-terminated.
+     */
+    char const* tag;
+    /*! @member tag_len
+     * Length of tag in bytes.
+     */
+    size_t tag_len;
+    /*! @member name
+     * Name of the section, which is not NUL-terminated.
+     */
+    char const* name;
+    /*! @member name_len
+     * Length of name in bytes.
+     * A length of zero implies that the section has no name.
+     */
+    size_t name_len;
+    /*! @member lines
+     * Lines of the body of the section, with the leading whitespace and '*'
+     * of each doc comment line removed.
+     */
+    struct cdoc_line const* lines;
+    /*! @member line_count
+     * Number of lines in the body.
+     */
+    size_t line_count;
+};
+
+/*!
+ * @struct cdoc_doc
+ * A doc comment along with the source code it documents, as passed to a
+ * cdoc_doc_fn.
+ * Every pointer refers to the buffer passed to cdoc_parse or to memory of
+ * the context, and is only valid until cdoc_parse returns.
+ */
+struct cdoc_doc
+{
+    /*! @member line
+     * 1-indexed line number of the first section of the doc.
+     */
+    unsigned long line;
+    /*! @member sections
+     * Sections of the doc in the order in which they appear.
+     */
+    struct cdoc_section const* sections;
+    /*! @member section_count
+     * Number of sections of the doc.
+     */
+    size_t section_count;
+    /*! @member source
+     * Lines of source code documented by the doc, leaving out the doc
+     * comment lines found within it.
+     */
+    struct cdoc_line const* source;
+    /*! @member source_count
+     * Number of lines of source code.
+     * A count of zero implies that the doc documents no source code.
+     */
+    size_t source_count;
+    /*! @member source_elided
+     * Non-zero if the source ends in a function body that was left out.
+     */
+    int source_elided;
+};
+
+/*!
+ * @typedef cdoc_doc_fn
+ * Callback through which cdoc_parse passes each doc of a buffer, in the
+ * order in which the docs appear.
+ * @param user
+ * Pointer passed to cdoc_parse.
+ */
+typedef void (*cdoc_doc_fn)(void* user, struct cdoc_doc const* doc);
+
+/*!
+ * @enum cdoc_filter
+ * Kind of filter selecting the docs passed to a cdoc_doc_fn, each matching
+ * the cdoc option of the same name.
+ */
+enum cdoc_filter
+{
+    CDOC_ONLY, // Comma-separated tags, one of which a doc must begin with.
+    CDOC_EXCLUDE_TAG, // Comma-separated tags no section of a doc may have.
+    CDOC_NAME, // Glob the name of a doc must match, if any is added.
+    CDOC_EXCLUDE_NAME // Glob the name of a doc may not match.
+};
+
+/*!
+ * @function cdoc_ctx_new
+ * Returns a new parser context with no filters, which stops at the first
+ * error of a buffer.
+ * @note
+ * Like the rest of libcdoc, exits the process with EXIT_FAILURE status if
+ * memory cannot be allocated.
+ */
+struct cdoc_ctx*
+cdoc_ctx_new(void);
+/*!
+ * @function cdoc_ctx_free
+ * Release ctx and every allocation it owns.
+ */
+void
+cdoc_ctx_free(struct cdoc_ctx* ctx);
+/*!
+ * @function cdoc_ctx_keep_going
+ * If enabled is non-zero, skip the docs of a buffer that have errors
+ * instead of stopping at the first one.
+ */
+void
+cdoc_ctx_keep_going(struct cdoc_ctx* ctx, int enabled);
+/*!
+ * @function cdoc_ctx_add_filter
+ * Add a filter of the provided kind to ctx, which applies to every later
+ * call to cdoc_parse.
+ * The value is copied.
+ * Returns zero, or -1 if a list of tags contains an empty tag.
+ */
+int
+cdoc_ctx_add_filter(
+    struct cdoc_ctx* ctx, enum cdoc_filter kind, char const* value);
+/*!
+ * @function cdoc_parse
+ * Parse the docs of the size bytes of C source at data and pass each doc
+ * selected by the filters of ctx to fn.
+ * No doc is passed if the buffer has an error, unless keep_going is
+ * enabled, in which case only the docs with errors are left out.
+ * Returns zero, or -1 if an error was found, in which case the errors are
+ * available through cdoc_error until the next call.
+ */
+int
+cdoc_parse(
+    struct cdoc_ctx* ctx,
+    char const* data,
+    size_t size,
+    cdoc_doc_fn fn,
+    void* user);
+/*!
+ * @function cdoc_error_count
+ * Returns the number of errors found by the last call to cdoc_parse.
+ */
+size_t
+cdoc_error_count(struct cdoc_ctx const* ctx);
+/*!
+ * @function cdoc_error
+ * Returns the NUL-terminated message of the error at index i of the last
+ * call to cdoc_parse, such as "[line 3] Empty doc-comment tag".
+ */
+char const*
+cdoc_error(struct cdoc_ctx const* ctx, size_t i);
+
+#endif // CDOC_H
@@ -0,0 +1,199 @@
+/*!
+ * @file fuzz.c
+ * Fuzz target for the parser of cdoc, for libFuzzer or AFL.
+ * The first byte of each input selects the function under test, and the
+ * rest of the input is the C source given to it.
+ * Besides the crashes and undefined behavior found by the sanitizers,
+ * every input must be parsed within a budget linear in its size, so that
+ * an input making the parser super-linear aborts and is saved by the
+ * fuzzer.
+ * @license 0BSD
+ */
+
+// The target is built from the cdoc translation unit itself so that the
+// parse functions can be called directly.
+#define main cdoc_main
+#include "../cdoc.c"
+#undef main
+
+/*!
+ * @macro FUZZ_BUDGET_BASE
+ * Seconds that an input of any size may take to be parsed.
+ * May be overridden with -D, e.g. for slower sanitizers.
+ */
+#if !defined(FUZZ_BUDGET_BASE)
+#    define FUZZ_BUDGET_BASE 0.05
+#endif
+/*!
+ * @macro FUZZ_BUDGET_PER_BYTE
+ * Seconds that each byte of an input adds to its budget.
+ * May be overridden with -D.
+ */
+#if !defined(FUZZ_BUDGET_PER_BYTE)
+#    define FUZZ_BUDGET_PER_BYTE 2e-6
+#endif
+
+/*!
+ * @enum fuzz_target
+ * Function under test, selected by the low bits of the first byte of an
+ * input.
+ */
+enum fuzz_target
+{
+    FUZZ_PARSE_TEXT, // parse_text, and so parse_doc, on a whole file.
+    FUZZ_STRUCT_SOURCE, // parse_struct_source from every line in turn.
+    FUZZ_FUNCTION_SOURCE, // parse_function_source from every line in turn.
+    FUZZ_MACRO_SOURCE, // parse_macro_source from every line in turn.
+    FUZZ_TARGET_COUNT
+};
+
+/*!
+ * @function fuzz_source
+ * Index the lines of text and call parse on every line that a previous
+ * call has not consumed, as parse_doc would for a doc on each such line.
+ */
+static void
+fuzz_source(
+    struct job* job,
+    struct text text,
+    void (*parse)(struct file const*, uint32_t*, struct doc*));
+/*!
+ * @function LLVMFuzzerTestOneInput
+ * Parse the size bytes at data, aborting if parsing takes longer than the
+ * budget of an input of that size.
+ * Returns zero, as libFuzzer expects.
+ */
+int
+LLVMFuzzerTestOneInput(uint8_t const* data, size_t size);
+
+#if !defined(CDOC_FUZZ_LIBFUZZER)
+/*!
+ * @function read_input
+ * Read the whole file at path, or standard input if path is NULL, into a
+ * heap-allocated buffer, and store its size in *size.
+ */
+static uint8_t*
+read_input(char const* path, size_t* size);
+
+// Without libFuzzer, the target runs each file argument, or standard input,
+// once. This is the program given to afl-fuzz, and the way to replay an
+// input saved by either fuzzer.
+int
+main(int argc, char** argv)
+{
+    for (int i = 1; i < argc || i == 1; ++i) {
+        size_t size;
+        uint8_t* const data = read_input(i < argc ? argv[i] : NULL, &size);
+        LLVMFuzzerTestOneInput(data, size);
+        free(data);
+    }
+    return EXIT_SUCCESS;
+}
+
+static uint8_t*
+read_input(char const* path, size_t* size)
+{
+    FILE* const stream = path != NULL ? fopen(path, "rb") : stdin;
+    if (stream == NULL) {
+        errorf("%s: %s", path, strerror(errno));
+    }
+    size_t cap = 4096;
+    uint8_t* data = xalloc(NULL, cap);
+    *size = 0;
+    for (;;) {
+        *size += fread(data + *size, 1, cap - *size, stream);
+        if (*size < cap) {
+            break;
+        }
+        cap *= 2;
+        data = xalloc(data, cap);
+    }
+    if (ferror(stream)) {
+        errorf("%s: Failed to read input", path != NULL ? path : "stdin");
+    }
+    if (stream != stdin) {
+        fclose(stream);
+    }
+    return data;
+}
+#endif
+
+int
+LLVMFuzzerTestOneInput(uint8_t const* data, size_t size)
+{
+    // Text with a NUL byte is rejected before it is parsed.
+    if (size == 0 || memchr(data + 1, '\0', size - 1) != NULL) {
+        return 0;
+    }
+    struct text text;
+    text.data = (char const*)data + 1;
+    text.size = size - 1;
+
+    // The arena persists between inputs, like that of a job of cdoc.
+    static struct arena arena;
+    struct options options = {0};
+    options.jobs = 1;
+    // The high bit of the first byte enables keep_going.
+    options.keep_going = (data[0] & 0x80) != 0;
+    struct job job = {0};
+    job.options = &options;
+    job.path = "fuzz";
+    job.arena = &arena;
+
+    double const start = clock_seconds();
+    switch (data[0] % FUZZ_TARGET_COUNT) {
+    case FUZZ_PARSE_TEXT: {
+        struct file f = {0};
+        struct doc* docs;
+        size_t doc_count;
+        parse_text(&job, text, &f, &docs, &doc_count);
+        break;
+    }
+    case FUZZ_STRUCT_SOURCE:
+        fuzz_source(&job, text, parse_struct_source);
+        break;
+    case FUZZ_FUNCTION_SOURCE:
+        fuzz_source(&job, text, parse_function_source);
+        break;
+    case FUZZ_MACRO_SOURCE:
+        fuzz_source(&job, text, parse_macro_source);
+        break;
+    }
+    double const elapsed = clock_seconds() - start;
+    double const budget = FUZZ_BUDGET_BASE + FUZZ_BUDGET_PER_BYTE * size;
+    if (elapsed > budget) {
+        fprintf(
+            stderr,
+            "error: Parsing %zu bytes took %.6fs, over the budget of %.6fs\n",
+            size,
+            elapsed,
+            budget);
+        abort();
+    }
+
+    clear_errors(&job);
+    arena_reset(&arena);
+    return 0;
+}
+
+static void
+fuzz_source(
+    struct job* job,
+    struct text text,
+    void (*parse)(struct file const*, uint32_t*, struct doc*))
+{
+    struct file f = {0};
+    if (!text_to_lines(job, text, &f)) {
+        return;
+    }
+    for (uint32_t line = 0; line < f.line_count;) {
+        struct doc d = {0};
+        d.source_start = line;
+        d.has_source = true;
+        parse(&f, &line, &d);
+        if (line > f.line_count || d.source_start + d.source_len != line) {
+            fprintf(stderr, "error: Source parsed past its lines\n");
+            abort();
+        }
+    }
+}